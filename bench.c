@@ -0,0 +1,295 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "render.h"
+#include "shm.h"
+
+// micro benchmarks of the renderers and the buffer setup, build it next to regrow and run it inside a
+// Wayland session for the shm stages:
+// gcc -O2 -o regrow-bench bench.c render.c tree.c shm.c -lwayland-client -lm
+
+static const struct{
+    uint16_t width;
+    uint16_t height;
+} resolutions[] = {
+        {640, 480},
+        {1920, 1080},
+        {3840, 2160},
+        {7680, 4320}
+};
+
+static const unsigned int seeds[] = {1, 2, 3, 5, 8, 13, 21, 34};
+
+#define SEED_COUNT (sizeof(seeds)/sizeof(seeds[0]))
+#define MIN_REPEATS 3
+#define MAX_REPEATS 50
+#define MAX_SAMPLES (SEED_COUNT*MAX_REPEATS)
+// time spent on one seed before it stops being repeated
+#define SEED_BUDGET_NS 50000000LL
+
+// glibc's allocator, the wrappers below count every call that goes through it
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static uint64_t allocations;
+
+void* malloc(size_t size){
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size){
+    allocations++;
+    return __libc_calloc(count,size);
+}
+
+void* realloc(void* ptr, size_t size){
+    allocations++;
+    return __libc_realloc(ptr,size);
+}
+
+struct bench_case{
+    uint32_t* data;
+    uint16_t width;
+    uint16_t height;
+    struct tree_params params;
+    struct memory_target* target;
+    struct tree_skeleton skeleton;
+    // only with a compositor to create the pool
+    struct shm_pool* pool;
+    struct shm_target* shm_target;
+};
+
+// where a stage leaves its pixels
+enum bench_output{
+    OUTPUT_NONE,
+    OUTPUT_DATA,
+    OUTPUT_MEMORY_TARGET,
+    OUTPUT_SHM_TARGET
+};
+
+typedef void (*bench_fn)(struct bench_case* bench);
+
+static void bench_draw_tree(struct bench_case* bench){
+    draw_tree(bench->data,bench->width,bench->height,bench->params.branch_width);
+}
+
+static void bench_draw_tree_new(struct bench_case* bench){
+    draw_tree_new(bench->data,bench->width/2+bench->width*(bench->height-1),bench->width,bench->height,bench->params.tree_size,bench->params.branch_width);
+}
+
+static void bench_draw_branches(struct bench_case* bench){
+    uint16_t width = bench->width;
+    uint16_t height = bench->height;
+    uint16_t branch_size = bench->params.branch_width/2;
+    draw_branches(bench->data,width/2+width*(height-height/4),&width,&height,&branch_size);
+}
+
+// what the window does for every frame: a buffer of its long lived pool, drawn into and put back. Only
+// the first call at a new size grows the pool, every later one reuses the slot.
+static void bench_shm_buffer(struct bench_case* bench){
+    struct shm_buffer* buffer = shm_pool_get_buffer(bench->pool,bench->width,bench->height);
+    if (buffer == NULL){
+        return;
+    }
+    uint32_t* data = shm_buffer_data(buffer);
+    // touch every page like the renderer would
+    for (size_t i = 0; i < (size_t)bench->width*bench->height; i += 1024) {
+        data[i] = 0;
+    }
+    shm_pool_put_buffer(buffer);
+}
+
+static void bench_generate(struct bench_case* bench){
+    generate_skeleton(&bench->skeleton,bench->width,bench->height,&bench->params);
+}
+
+// rasterizes the skeleton of the current seed, generated before the timing starts
+static void bench_rasterize(struct bench_case* bench){
+    rasterize_skeleton(&bench->skeleton,bench->data,bench->width,bench->height,NULL);
+}
+
+// a whole tree into a memory target, what --headless and the worker of a window without subsurfaces run
+static void bench_render_tree(struct bench_case* bench){
+    render_tree(&bench->target->base,bench->width,bench->height,&bench->params);
+}
+
+// a whole tree straight into a buffer of the pool, what the render thread and the worker of a layered
+// window run together
+static void bench_shm_frame(struct bench_case* bench){
+    if (render_target_prepare(&bench->shm_target->base,bench->width,bench->height)){
+        render_tree(&bench->shm_target->base,bench->width,bench->height,&bench->params);
+    }
+}
+
+static const struct{
+    const char* name;
+    bench_fn fn;
+    enum bench_output output;
+    // skipped without a wl_shm
+    bool needs_pool;
+} stages[] = {
+        {"draw_tree", bench_draw_tree, OUTPUT_DATA, false},
+        {"draw_tree_new", bench_draw_tree_new, OUTPUT_DATA, false},
+        {"draw_branches", bench_draw_branches, OUTPUT_DATA, false},
+        {"generate", bench_generate, OUTPUT_NONE, false},
+        {"rasterize", bench_rasterize, OUTPUT_DATA, false},
+        {"render_tree", bench_render_tree, OUTPUT_MEMORY_TARGET, false},
+        {"shm_buffer", bench_shm_buffer, OUTPUT_NONE, true},
+        {"shm_frame", bench_shm_frame, OUTPUT_SHM_TARGET, true},
+};
+
+static void registry_global(void* data, struct wl_registry* wl_registry, uint32_t name, const char* interface, uint32_t version){
+    struct wl_shm** shm = data;
+    if (strcmp(interface,wl_shm_interface.name) == 0){
+        *shm = wl_registry_bind(wl_registry,name,&wl_shm_interface,1);
+    }
+}
+
+static void registry_global_remove(void* data, struct wl_registry* wl_registry, uint32_t name){
+}
+
+static const struct wl_registry_listener registry_listener = {
+        .global = registry_global,
+        .global_remove = registry_global_remove
+};
+
+static int64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000000000LL+ts.tv_nsec;
+}
+
+static int compare_ns(const void* a, const void* b){
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t count_pixels(const uint32_t* data, size_t pixels){
+    uint64_t count = 0;
+    for (size_t i = 0; i < pixels; ++i) {
+        count += data[i] != 0;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]){
+    const char* output = "regrow-bench.csv";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i],"--output") == 0 && i+1 < argc){
+            output = argv[++i];
+        }
+    }
+    FILE* results = fopen(output,"w");
+    if (results == NULL){
+        fprintf(stderr,"Error opening %s.\n",output);
+        return -1;
+    }
+    // the pool needs a compositor to share it with, without one only the renderers are timed
+    struct wl_display* display = wl_display_connect(NULL);
+    struct wl_shm* shm = NULL;
+    struct shm_pool* pool = NULL;
+    struct shm_target* shm_target = NULL;
+    if (display != NULL){
+        struct wl_registry* registry = wl_display_get_registry(display);
+        wl_registry_add_listener(registry,&registry_listener,&shm);
+        wl_display_roundtrip(display);
+        wl_registry_destroy(registry);
+    }
+    if (shm != NULL){
+        pool = shm_pool_create(shm,(size_t)resolutions[0].width*resolutions[0].height*4);
+        shm_target = pool != NULL ? shm_target_create(pool) : NULL;
+    }
+    if (shm_target == NULL){
+        printf("No wl_shm, skipping the shm stages.\n");
+    }
+
+    fprintf(results,"stage,width,height,samples,median_ns,p99_ns,pixels_per_second,allocations_per_call\n");
+    printf("%-14s %11s %8s %14s %14s %16s %8s\n","stage","size","samples","median [us]","p99 [us]","pixels/s","allocs");
+
+    int64_t* samples = malloc(MAX_SAMPLES*sizeof(int64_t));
+    for (size_t r = 0; r < sizeof(resolutions)/sizeof(resolutions[0]); ++r) {
+        struct bench_case bench = {0};
+        bench.width = resolutions[r].width;
+        bench.height = resolutions[r].height;
+        const size_t pixels = (size_t)bench.width*bench.height;
+        bench.data = malloc(pixels*4);
+        bench.target = memory_target_create(NULL,IMAGE_FORMAT_PPM);
+        bench.pool = pool;
+        bench.shm_target = shm_target;
+        tree_skeleton_init(&bench.skeleton);
+        if (bench.data == NULL || bench.target == NULL){
+            fprintf(stderr,"Error allocating %dx%d.\n",bench.width,bench.height);
+            return -1;
+        }
+
+        for (size_t s = 0; s < sizeof(stages)/sizeof(stages[0]); ++s) {
+            if (stages[s].needs_pool && shm_target == NULL){
+                continue;
+            }
+            int count = 0;
+            int64_t total_ns = 0;
+            uint64_t total_pixels = 0;
+            uint64_t total_allocations = 0;
+            for (size_t seed = 0; seed < SEED_COUNT; ++seed) {
+                srand(seeds[seed]);
+                bench.params = tree_params_random(bench.width,bench.height);
+                generate_skeleton(&bench.skeleton,bench.width,bench.height,&bench.params);
+                int64_t seed_start = now_ns();
+                for (int repeat = 0; repeat < MAX_REPEATS; ++repeat) {
+                    memset(bench.data,0,pixels*4);
+                    uint64_t allocations_before = allocations;
+                    int64_t start = now_ns();
+                    stages[s].fn(&bench);
+                    int64_t elapsed = now_ns()-start;
+                    total_allocations += allocations-allocations_before;
+                    samples[count++] = elapsed;
+                    total_ns += elapsed;
+                    const uint32_t* data = NULL;
+                    if (stages[s].output == OUTPUT_DATA){
+                        data = bench.data;
+                    }else if (stages[s].output == OUTPUT_MEMORY_TARGET){
+                        data = bench.target->base.data;
+                    }else if (stages[s].output == OUTPUT_SHM_TARGET){
+                        data = bench.shm_target->base.data;
+                    }
+                    if (data != NULL){
+                        total_pixels += count_pixels(data,pixels);
+                    }
+                    if (repeat+1 >= MIN_REPEATS && now_ns()-seed_start > SEED_BUDGET_NS){
+                        break;
+                    }
+                }
+            }
+            qsort(samples,count,sizeof(int64_t),compare_ns);
+            int64_t median = samples[count/2];
+            int64_t p99 = samples[(count*99)/100 < count ? (count*99)/100 : count-1];
+            double pixels_per_second = total_ns > 0 ? total_pixels*1e9/total_ns : 0;
+            double allocations_per_call = (double)total_allocations/count;
+            fprintf(results,"%s,%d,%d,%d,%lld,%lld,%.0f,%.2f\n",stages[s].name,bench.width,bench.height,count,(long long)median,(long long)p99,pixels_per_second,allocations_per_call);
+            printf("%-14s %5dx%-5d %8d %14.1f %14.1f %16.0f %8.2f\n",stages[s].name,bench.width,bench.height,count,median/1e3,p99/1e3,pixels_per_second,allocations_per_call);
+        }
+        render_target_destroy(&bench.target->base);
+        tree_skeleton_finish(&bench.skeleton);
+        free(bench.data);
+    }
+    free(samples);
+    render_target_destroy(shm_target != NULL ? &shm_target->base : NULL);
+    if (pool != NULL){
+        shm_pool_destroy(pool);
+    }
+    if (shm != NULL){
+        wl_shm_destroy(shm);
+    }
+    if (display != NULL){
+        wl_display_disconnect(display);
+    }
+    fclose(results);
+    printf("Results written to %s\n",output);
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "render.h"
+
+// renders trees for fixed seeds and sizes without a compositor and compares a checksum of every image with
+// the one recorded below, so a change to the generator or the rasterizer can't change pixels unnoticed.
+// Build it next to regrow and run it after touching tree.c or render.c:
+// gcc -O2 -o regrow-check check.c render.c tree.c -lm
+// ./regrow-check --print writes the table for the current output.
+
+static const struct{
+    uint16_t width;
+    uint16_t height;
+} sizes[] = {
+        {640, 480},
+        {1920, 1080},
+        {333, 777},
+        {200, 150}
+};
+
+static const unsigned int seeds[] = {1, 2, 3, 5, 8, 13, 21, 34};
+
+#define SIZE_COUNT (sizeof(sizes)/sizeof(sizes[0]))
+#define SEED_COUNT (sizeof(seeds)/sizeof(seeds[0]))
+
+// FNV-1a of the pixels, row by row, for sizes[i] and seeds[j] at [i*SEED_COUNT+j]. Recorded with the
+// rasterizer that clips the segments to the buffer, it draws the trees of the original renderers exactly
+// except for the pixels that used to wrap around into the next row.
+static const uint64_t expected[SIZE_COUNT*SEED_COUNT] = {
+        0x2904da94201fc07dull,
+        0xb63173c74568b215ull,
+        0xa48274ca33961d45ull,
+        0xcdaf5a15790c773dull,
+        0xae893b9255825435ull,
+        0xcff9f3a4b74d2a05ull,
+        0x8a2c88466bf1ed15ull,
+        0xa2d7147ef7b12375ull,
+        0x2353135f2dc3b945ull,
+        0xfd9c243fb4148a35ull,
+        0xca5c5e17888169a5ull,
+        0x27b5e963e337ffddull,
+        0xfb85dd11d92b2bbdull,
+        0x7164c42de17d26bdull,
+        0xf157032b6a99ededull,
+        0x2460f73b999b3f95ull,
+        0x19aed5ce55966345ull,
+        0x591e5e1cf9705f85ull,
+        0xf2c5857a8e2fe115ull,
+        0x72f3e62d3798e0b5ull,
+        0x816e2354a6e27b1dull,
+        0x1845674d993c70bdull,
+        0xe2cd36a0d66d5775ull,
+        0x6d7ecf759d440455ull,
+        0xe94d157b19346225ull,
+        0x8ea045afa060758dull,
+        0x2d2c8f26232265fdull,
+        0x2d23bfb181f7d00dull,
+        0x8a23370fafe5d85dull,
+        0xe94d157b19346225ull,
+        0xeb174fa7b31a8565ull,
+        0xdec9feae01598755ull
+};
+
+static uint64_t checksum(const uint32_t* data, size_t pixels){
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < pixels; ++i) {
+        for (int b = 0; b < 4; ++b) {
+            hash ^= (data[i]>>(8*b))&0xFF;
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char *argv[]){
+    const bool print = argc > 1 && strcmp(argv[1],"--print") == 0;
+    struct memory_target* target = memory_target_create(NULL,IMAGE_FORMAT_PPM);
+    if (target == NULL){
+        fprintf(stderr,"Error creating the render target.\n");
+        return -1;
+    }
+    int failed = 0;
+    for (size_t i = 0; i < SIZE_COUNT; ++i) {
+        for (size_t j = 0; j < SEED_COUNT; ++j) {
+            const uint16_t width = sizes[i].width;
+            const uint16_t height = sizes[i].height;
+            // the same trees as regrow --headless 1 --seed N --size WxH
+            srand(seeds[j]);
+            struct tree_params params = tree_params_random(width,height);
+            if (!render_tree(&target->base,width,height,&params)){
+                fprintf(stderr,"Error rendering %dx%d.\n",width,height);
+                return -1;
+            }
+            const uint64_t hash = checksum(target->base.data,(size_t)width*height);
+            if (print){
+                printf("        0x%016llxull,\n",(unsigned long long)hash);
+            }else if (hash != expected[i*SEED_COUNT+j]){
+                printf("%dx%d seed %u: 0x%016llx instead of 0x%016llx\n",width,height,seeds[j],
+                       (unsigned long long)hash,(unsigned long long)expected[i*SEED_COUNT+j]);
+                failed++;
+            }
+        }
+    }
+    render_target_destroy(&target->base);
+    if (!print){
+        printf("%d of %d trees changed\n",failed,(int)(SIZE_COUNT*SEED_COUNT));
+    }
+    return failed > 0 ? 1 : 0;
+}
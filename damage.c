@@ -0,0 +1,115 @@
+#include "damage.h"
+
+bool damage_rect_is_empty(struct damage_rect rect){
+    return rect.width <= 0 || rect.height <= 0;
+}
+
+struct damage_rect damage_rect_union(struct damage_rect a, struct damage_rect b){
+    if (damage_rect_is_empty(a)){
+        return b;
+    }
+    if (damage_rect_is_empty(b)){
+        return a;
+    }
+    int32_t x1 = a.x < b.x ? a.x : b.x;
+    int32_t y1 = a.y < b.y ? a.y : b.y;
+    int32_t x2 = a.x+a.width > b.x+b.width ? a.x+a.width : b.x+b.width;
+    int32_t y2 = a.y+a.height > b.y+b.height ? a.y+a.height : b.y+b.height;
+    return (struct damage_rect){x1, y1, x2-x1, y2-y1};
+}
+
+struct damage_rect damage_rect_intersect(struct damage_rect a, struct damage_rect b){
+    int32_t x1 = a.x > b.x ? a.x : b.x;
+    int32_t y1 = a.y > b.y ? a.y : b.y;
+    int32_t x2 = a.x+a.width < b.x+b.width ? a.x+a.width : b.x+b.width;
+    int32_t y2 = a.y+a.height < b.y+b.height ? a.y+a.height : b.y+b.height;
+    if (x2 <= x1 || y2 <= y1){
+        return (struct damage_rect){0};
+    }
+    return (struct damage_rect){x1, y1, x2-x1, y2-y1};
+}
+
+static int64_t rect_area(struct damage_rect rect){
+    return damage_rect_is_empty(rect) ? 0 : (int64_t)rect.width*rect.height;
+}
+
+static bool rects_overlap(struct damage_rect a, struct damage_rect b){
+    return a.x < b.x+b.width && b.x < a.x+a.width && a.y < b.y+b.height && b.y < a.y+a.height;
+}
+
+// b continues a in one direction with the same extent, so their union covers nothing else
+static bool rects_continue(struct damage_rect a, struct damage_rect b){
+    if (a.x == b.x && a.width == b.width){
+        return a.y+a.height == b.y || b.y+b.height == a.y;
+    }
+    if (a.y == b.y && a.height == b.height){
+        return a.x+a.width == b.x || b.x+b.width == a.x;
+    }
+    return false;
+}
+
+static void remove_rect(struct damage* damage, int i){
+    damage->rects[i] = damage->rects[--damage->count];
+}
+
+void damage_clear(struct damage* damage){
+    damage->count = 0;
+}
+
+void damage_add(struct damage* damage, struct damage_rect rect){
+    if (damage_rect_is_empty(rect)){
+        return;
+    }
+    // the union can grow into other rectangles, so the search starts over after every merge
+    bool merged = true;
+    while (merged){
+        merged = false;
+        for (int i = 0; i < damage->count; ++i) {
+            if (rects_overlap(rect,damage->rects[i]) || rects_continue(rect,damage->rects[i])){
+                rect = damage_rect_union(rect,damage->rects[i]);
+                remove_rect(damage,i);
+                merged = true;
+                break;
+            }
+        }
+        if (!merged && damage->count == DAMAGE_MAX_RECTS){
+            // no room left, merge with the rectangle that adds the least area
+            int best = 0;
+            int64_t best_cost = INT64_MAX;
+            for (int i = 0; i < damage->count; ++i) {
+                int64_t cost = rect_area(damage_rect_union(rect,damage->rects[i]))-rect_area(rect)-rect_area(damage->rects[i]);
+                if (cost < best_cost){
+                    best = i;
+                    best_cost = cost;
+                }
+            }
+            rect = damage_rect_union(rect,damage->rects[best]);
+            remove_rect(damage,best);
+            merged = true;
+        }
+    }
+    damage->rects[damage->count++] = rect;
+}
+
+void damage_add_damage(struct damage* damage, const struct damage* other){
+    for (int i = 0; i < other->count; ++i) {
+        damage_add(damage,other->rects[i]);
+    }
+}
+
+void damage_full(struct damage* damage, int32_t width, int32_t height){
+    damage->count = 0;
+    damage_add(damage,(struct damage_rect){0, 0, width, height});
+}
+
+bool damage_is_empty(const struct damage* damage){
+    return damage->count == 0;
+}
+
+int64_t damage_area(const struct damage* damage){
+    int64_t area = 0;
+    for (int i = 0; i < damage->count; ++i) {
+        area += rect_area(damage->rects[i]);
+    }
+    return area;
+}
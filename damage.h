@@ -0,0 +1,36 @@
+#ifndef REGROW_DAMAGE_H
+#define REGROW_DAMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// rectangles a damage set can hold before the ones that are closest get merged
+#define DAMAGE_MAX_RECTS 8
+
+struct damage_rect{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+// dirty part of a buffer as a small set of rectangles that never overlap
+struct damage{
+    struct damage_rect rects[DAMAGE_MAX_RECTS];
+    int count;
+};
+
+bool damage_rect_is_empty(struct damage_rect rect);
+struct damage_rect damage_rect_union(struct damage_rect a, struct damage_rect b);
+struct damage_rect damage_rect_intersect(struct damage_rect a, struct damage_rect b);
+
+void damage_clear(struct damage* damage);
+// adds the rectangle, anything it overlaps (or continues exactly) is merged with it
+void damage_add(struct damage* damage, struct damage_rect rect);
+void damage_add_damage(struct damage* damage, const struct damage* other);
+// a single rectangle covering the whole buffer
+void damage_full(struct damage* damage, int32_t width, int32_t height);
+bool damage_is_empty(const struct damage* damage);
+int64_t damage_area(const struct damage* damage);
+
+#endif
@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "timing.h"
+#include "trace.h"
+
+bool event_loop_init(struct event_loop* loop, struct wl_display* display, struct wl_event_queue* queue){
+    loop->display = display;
+    loop->queue = queue;
+    loop->display_fd = wl_display_get_fd(display);
+    loop->flush_blocked = false;
+    loop->timed = false;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1){
+        fprintf(stderr,"Error creating the event loop.\n");
+        return false;
+    }
+    if (!event_loop_add(loop,loop->display_fd,EVENT_LOOP_DISPLAY)){
+        event_loop_finish(loop);
+        return false;
+    }
+    return true;
+}
+
+void event_loop_finish(struct event_loop* loop){
+    if (loop->epoll_fd >= 0){
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+}
+
+bool event_loop_add(struct event_loop* loop, int fd, uint32_t tag){
+    struct epoll_event event = {.events = EPOLLIN, .data.u32 = tag};
+    if (epoll_ctl(loop->epoll_fd,EPOLL_CTL_ADD,fd,&event) == -1){
+        fprintf(stderr,"Error adding a file descriptor to the event loop.\n");
+        return false;
+    }
+    return true;
+}
+
+static int prepare_read(struct event_loop* loop){
+    return loop->queue != NULL ? wl_display_prepare_read_queue(loop->display,loop->queue) : wl_display_prepare_read(loop->display);
+}
+
+static int dispatch_pending(struct event_loop* loop){
+    return loop->queue != NULL ? wl_display_dispatch_queue_pending(loop->display,loop->queue) : wl_display_dispatch_pending(loop->display);
+}
+
+bool event_loop_prepare(struct event_loop* loop){
+    // a thread that's prepared to read always wakes up with the others, the events another thread read
+    // for this queue are dispatched here before it can go to sleep
+    while (prepare_read(loop) != 0){
+        if (dispatch_pending(loop) == -1){
+            return false;
+        }
+    }
+    // the only flush of the iteration, the requests of all handlers go out together
+    const bool blocked = wl_display_flush(loop->display) == -1;
+    if (blocked && errno != EAGAIN){
+        wl_display_cancel_read(loop->display);
+        return false;
+    }
+    if (blocked != loop->flush_blocked){
+        struct epoll_event event = {.events = blocked ? EPOLLIN|EPOLLOUT : EPOLLIN, .data.u32 = EVENT_LOOP_DISPLAY};
+        epoll_ctl(loop->epoll_fd,EPOLL_CTL_MOD,loop->display_fd,&event);
+        loop->flush_blocked = blocked;
+    }
+    return true;
+}
+
+int event_loop_wait(struct event_loop* loop, struct epoll_event* events){
+    const uint64_t start = timing_now();
+    const int ready = epoll_wait(loop->epoll_fd,events,EVENT_LOOP_MAX_EVENTS,-1);
+    if (loop->timed){
+        timing_record(TIMING_DISPATCH_WAIT,start);
+    }
+    trace_end("epoll_wait",start);
+    if (ready < 0){
+        wl_display_cancel_read(loop->display);
+        return errno == EINTR ? 0 : -1;
+    }
+    bool readable = false;
+    int count = 0;
+    for (int i = 0; i < ready; ++i) {
+        if (events[i].data.u32 == EVENT_LOOP_DISPLAY){
+            // EPOLLHUP and EPOLLERR make the read fail
+            readable = readable || (events[i].events & ~EPOLLOUT) != 0;
+        }else{
+            events[count++] = events[i];
+        }
+    }
+    if (readable){
+        if (wl_display_read_events(loop->display) == -1){
+            return -1;
+        }
+    }else{
+        wl_display_cancel_read(loop->display);
+    }
+    if (dispatch_pending(loop) == -1){
+        return -1;
+    }
+    return count;
+}
@@ -0,0 +1,39 @@
+#ifndef REGROW_EVENT_LOOP_H
+#define REGROW_EVENT_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <wayland-client.h>
+
+// tag of the display in epoll_event.data.u32, the other file descriptors get theirs from event_loop_add
+#define EVENT_LOOP_DISPLAY 0
+// most events one wait returns
+#define EVENT_LOOP_MAX_EVENTS 8
+
+// epoll over the display and the other file descriptors of one thread. Every thread has its own loop and
+// dispatches only its own event queue, the display is read by all threads that wait for it together.
+struct event_loop{
+    struct wl_display* display;
+    // NULL for the default queue
+    struct wl_event_queue* queue;
+    int display_fd;
+    int epoll_fd;
+    // the display also waits for EPOLLOUT while the socket was too full to flush everything
+    bool flush_blocked;
+    // the next wait is recorded as TIMING_DISPATCH_WAIT
+    bool timed;
+};
+
+bool event_loop_init(struct event_loop* loop, struct wl_display* display, struct wl_event_queue* queue);
+void event_loop_finish(struct event_loop* loop);
+// wakes the loop up when fd gets readable, its events are returned with the given tag
+bool event_loop_add(struct event_loop* loop, int fd, uint32_t tag);
+// dispatches what's queued and flushes everything the handlers requested at once, returns false once the
+// connection is lost. After that nothing can be dispatched until event_loop_wait.
+bool event_loop_prepare(struct event_loop* loop);
+// waits and dispatches the events that arrived. The events of the other file descriptors are stored in
+// events (EVENT_LOOP_MAX_EVENTS), returns how many there are or -1 once the connection is lost.
+int event_loop_wait(struct event_loop* loop, struct epoll_event* events);
+
+#endif
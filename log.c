@@ -0,0 +1,219 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "timing.h"
+
+static struct log_record records[LOG_RING_SIZE];
+// next record a producer claims, several threads can log at the same time
+static _Atomic uint32_t log_tail = 0;
+// only used by the writer
+static uint32_t log_head = 0;
+static _Atomic uint64_t dropped = 0;
+static uint64_t reported_dropped = 0;
+
+static pthread_t writer;
+static _Atomic bool started = false;
+static _Atomic bool running = false;
+
+struct log_arg log_arg_integer(int64_t value){
+    return (struct log_arg){.type = LOG_ARG_INTEGER, .integer = value};
+}
+
+struct log_arg log_arg_double(double value){
+    return (struct log_arg){.type = LOG_ARG_DOUBLE, .real = value};
+}
+
+struct log_arg log_arg_string(const char* value){
+    return (struct log_arg){.type = LOG_ARG_STRING, .string = value ? value : "(null)"};
+}
+
+// copies the message into the record, strings included, so the caller's buffers can go away
+static void fill_record(struct log_record* record, int level, const char* format, int count, const struct log_arg* args){
+    record->level = level;
+    record->time = timing_now();
+    record->format = format;
+    record->count = count < LOG_MAX_ARGS ? count : LOG_MAX_ARGS;
+    uint32_t used = 0;
+    for (int i = 0; i < record->count; ++i) {
+        record->types[i] = args[i].type;
+        if (args[i].type == LOG_ARG_STRING){
+            const size_t left = LOG_TEXT_SIZE-used;
+            size_t length = strlen(args[i].string);
+            length = length < left-1 ? length : left-1;
+            memcpy(record->text+used,args[i].string,length);
+            record->text[used+length] = '\0';
+            record->args[i].string = used;
+            used += length+1;
+            if (used >= LOG_TEXT_SIZE){
+                used = LOG_TEXT_SIZE-1;
+            }
+        }else if (args[i].type == LOG_ARG_DOUBLE){
+            record->args[i].real = args[i].real;
+        }else{
+            record->args[i].integer = args[i].integer;
+        }
+    }
+}
+
+// printf for a record, every conversion is formatted on its own with the type the argument was recorded with
+static void format_record(const struct log_record* record, char* out, size_t size){
+    size_t length = 0;
+    int arg = 0;
+    const char* c = record->format;
+    while (*c != '\0' && length+1 < size){
+        if (*c != '%'){
+            out[length++] = *c++;
+            continue;
+        }
+        if (c[1] == '%'){
+            out[length++] = '%';
+            c += 2;
+            continue;
+        }
+        // flags, width and precision are kept, the length modifiers are replaced
+        char spec[32] = "%";
+        size_t spec_length = 1;
+        const char* start = c++;
+        while (*c != '\0' && strchr("-+ #0123456789.",*c) != NULL && spec_length < sizeof(spec)-4){
+            spec[spec_length++] = *c++;
+        }
+        while (*c != '\0' && strchr("hlLzjt",*c) != NULL){
+            c++;
+        }
+        const char conversion = *c;
+        if (conversion == '\0' || arg >= record->count){
+            // the format doesn't match the arguments, it's printed as it is
+            const size_t rest = strlen(start);
+            const size_t copied = rest < size-1-length ? rest : size-1-length;
+            memcpy(out+length,start,copied);
+            length += copied;
+            break;
+        }
+        c++;
+        const uint8_t type = record->types[arg];
+        double real = type == LOG_ARG_DOUBLE ? record->args[arg].real : (double)record->args[arg].integer;
+        long long integer = type == LOG_ARG_DOUBLE ? (long long)record->args[arg].real : record->args[arg].integer;
+        int written = 0;
+        if (strchr("di",conversion) != NULL){
+            memcpy(spec+spec_length,"ll",2);
+            spec[spec_length+2] = conversion;
+            spec[spec_length+3] = '\0';
+            written = snprintf(out+length,size-length,spec,integer);
+        }else if (strchr("ouxX",conversion) != NULL){
+            memcpy(spec+spec_length,"ll",2);
+            spec[spec_length+2] = conversion;
+            spec[spec_length+3] = '\0';
+            written = snprintf(out+length,size-length,spec,(unsigned long long)integer);
+        }else if (strchr("fFeEgGaA",conversion) != NULL){
+            spec[spec_length] = conversion;
+            spec[spec_length+1] = '\0';
+            written = snprintf(out+length,size-length,spec,real);
+        }else if (conversion == 'c'){
+            spec[spec_length] = conversion;
+            spec[spec_length+1] = '\0';
+            written = snprintf(out+length,size-length,spec,(int)integer);
+        }else if (conversion == 's' && type == LOG_ARG_STRING){
+            spec[spec_length] = conversion;
+            spec[spec_length+1] = '\0';
+            written = snprintf(out+length,size-length,spec,record->text+record->args[arg].string);
+        }
+        arg++;
+        if (written > 0){
+            length += (size_t)written < size-length ? (size_t)written : size-length-1;
+        }
+    }
+    out[length] = '\0';
+}
+
+static void print_record(const struct log_record* record){
+    char line[512];
+    format_record(record,line,sizeof(line));
+    fputs(line,record->level >= LOG_LEVEL_WARN ? stderr : stdout);
+}
+
+// prints every record that's complete, in the order they were claimed
+static void drain_records(void){
+    while (true){
+        struct log_record* record = &records[log_head%LOG_RING_SIZE];
+        if (atomic_load_explicit(&record->sequence,memory_order_acquire) != log_head+1){
+            break;
+        }
+        print_record(record);
+        // the slot can be claimed again one lap later
+        atomic_store_explicit(&record->sequence,log_head+LOG_RING_SIZE,memory_order_release);
+        log_head++;
+    }
+    const uint64_t lost = atomic_load_explicit(&dropped,memory_order_relaxed);
+    if (lost != reported_dropped){
+        fprintf(stderr,"Error: %llu log messages were dropped, the log buffer was full.\n",(unsigned long long)(lost-reported_dropped));
+        reported_dropped = lost;
+    }
+    fflush(stdout);
+}
+
+static void* log_writer_run(void* data){
+    const struct timespec interval = {0, 10000000};
+    while (atomic_load(&running)){
+        drain_records();
+        nanosleep(&interval,NULL);
+    }
+    return NULL;
+}
+
+void log_start(void){
+    for (uint32_t i = 0; i < LOG_RING_SIZE; ++i) {
+        atomic_store_explicit(&records[i].sequence,i,memory_order_relaxed);
+    }
+    atomic_store(&log_tail,0);
+    log_head = 0;
+    atomic_store(&running,true);
+    if (pthread_create(&writer,NULL,log_writer_run,NULL) != 0){
+        fprintf(stderr,"Error starting the log writer, messages are printed right away.\n");
+        atomic_store(&running,false);
+        return;
+    }
+    atomic_store(&started,true);
+}
+
+void log_stop(void){
+    if (!atomic_load(&started)){
+        return;
+    }
+    atomic_store(&started,false);
+    atomic_store(&running,false);
+    pthread_join(writer,NULL);
+    drain_records();
+}
+
+void log_write(int level, const char* format, int count, const struct log_arg* args){
+    if (!atomic_load_explicit(&started,memory_order_acquire)){
+        // before the writer runs (or after it stopped) the message is printed right away
+        struct log_record record;
+        fill_record(&record,level,format,count,args);
+        print_record(&record);
+        return;
+    }
+    uint32_t position = atomic_load_explicit(&log_tail,memory_order_relaxed);
+    struct log_record* record;
+    while (true){
+        record = &records[position%LOG_RING_SIZE];
+        const uint32_t sequence = atomic_load_explicit(&record->sequence,memory_order_acquire);
+        const int32_t difference = (int32_t)(sequence-position);
+        if (difference == 0){
+            if (atomic_compare_exchange_weak_explicit(&log_tail,&position,position+1,memory_order_relaxed,memory_order_relaxed)){
+                break;
+            }
+        }else if (difference < 0){
+            // the writer is a whole ring behind, the message is lost rather than waiting for it
+            atomic_fetch_add_explicit(&dropped,1,memory_order_relaxed);
+            return;
+        }else{
+            position = atomic_load_explicit(&log_tail,memory_order_relaxed);
+        }
+    }
+    fill_record(record,level,format,count,args);
+    atomic_store_explicit(&record->sequence,position+1,memory_order_release);
+}
@@ -0,0 +1,107 @@
+#ifndef REGROW_LOG_H
+#define REGROW_LOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+// messages below this level are compiled out, -DLOG_LEVEL=0 keeps everything
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// records that can wait for the writer, the ones that don't fit are dropped and counted
+#define LOG_RING_SIZE 1024
+#define LOG_MAX_ARGS 6
+// string arguments are copied into the record, longer ones are cut off
+#define LOG_TEXT_SIZE 64
+
+enum log_arg_type{
+    LOG_ARG_INTEGER,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING
+};
+
+struct log_arg{
+    enum log_arg_type type;
+    union{
+        int64_t integer;
+        double real;
+        const char* string;
+    };
+};
+
+// a message that isn't formatted yet, format has to be a string literal
+struct log_record{
+    _Atomic uint32_t sequence;
+    uint8_t level;
+    uint8_t count;
+    uint64_t time;
+    const char* format;
+    union{
+        int64_t integer;
+        double real;
+        // offset into text
+        uint32_t string;
+    } args[LOG_MAX_ARGS];
+    uint8_t types[LOG_MAX_ARGS];
+    char text[LOG_TEXT_SIZE];
+};
+
+// starts the thread that formats and prints the records, before that nothing is printed
+void log_start(void);
+// prints what's left and stops the thread
+void log_stop(void);
+// queues the message without formatting it, safe to call from any thread
+void log_write(int level, const char* format, int count, const struct log_arg* args);
+
+struct log_arg log_arg_integer(int64_t value);
+struct log_arg log_arg_double(double value);
+struct log_arg log_arg_string(const char* value);
+
+// picks the type of every argument at compile time, integers, floating point numbers and strings are supported
+#define LOG_ARG(x) _Generic((x), char*: log_arg_string, const char*: log_arg_string, \
+        float: log_arg_double, double: log_arg_double, default: log_arg_integer)(x)
+#define LOG_COUNT(...) LOG_COUNT_(__VA_ARGS__,6,5,4,3,2,1,0,)
+#define LOG_COUNT_(f,a,b,c,d,e,g,n,...) n
+#define LOG_FORMAT(...) LOG_FORMAT_(__VA_ARGS__,)
+#define LOG_FORMAT_(f,...) f
+#define LOG_ARGS_0(f)
+#define LOG_ARGS_1(f,a) ,LOG_ARG(a)
+#define LOG_ARGS_2(f,a,b) ,LOG_ARG(a),LOG_ARG(b)
+#define LOG_ARGS_3(f,a,b,c) ,LOG_ARG(a),LOG_ARG(b),LOG_ARG(c)
+#define LOG_ARGS_4(f,a,b,c,d) ,LOG_ARG(a),LOG_ARG(b),LOG_ARG(c),LOG_ARG(d)
+#define LOG_ARGS_5(f,a,b,c,d,e) ,LOG_ARG(a),LOG_ARG(b),LOG_ARG(c),LOG_ARG(d),LOG_ARG(e)
+#define LOG_ARGS_6(f,a,b,c,d,e,g) ,LOG_ARG(a),LOG_ARG(b),LOG_ARG(c),LOG_ARG(d),LOG_ARG(e),LOG_ARG(g)
+#define LOG_CONCAT(a,b) LOG_CONCAT_(a,b)
+#define LOG_CONCAT_(a,b) a##b
+// the first element only keeps the array from being empty
+#define LOG_WRITE(level,...) log_write(level,LOG_FORMAT(__VA_ARGS__),LOG_COUNT(__VA_ARGS__), \
+        (const struct log_arg[]){{0} LOG_CONCAT(LOG_ARGS_,LOG_COUNT(__VA_ARGS__))(__VA_ARGS__)}+1)
+
+// a message below LOG_LEVEL is still type checked, but never evaluated
+#define LOG_DISCARD(...) (0 ? LOG_WRITE(LOG_LEVEL_DEBUG,__VA_ARGS__) : (void)0)
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(...) LOG_WRITE(LOG_LEVEL_DEBUG,__VA_ARGS__)
+#else
+#define log_debug(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define log_info(...) LOG_WRITE(LOG_LEVEL_INFO,__VA_ARGS__)
+#else
+#define log_info(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define log_warn(...) LOG_WRITE(LOG_LEVEL_WARN,__VA_ARGS__)
+#else
+#define log_warn(...) LOG_DISCARD(__VA_ARGS__)
+#endif
+#define log_error(...) LOG_WRITE(LOG_LEVEL_ERROR,__VA_ARGS__)
+
+#endif
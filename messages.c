@@ -0,0 +1,60 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "messages.h"
+
+bool message_queue_init(struct message_queue* queue){
+    atomic_store(&queue->head,0);
+    atomic_store(&queue->tail,0);
+    queue->fd = eventfd(0,EFD_CLOEXEC|EFD_NONBLOCK);
+    if (queue->fd < 0){
+        fprintf(stderr,"Error creating the message eventfd.\n");
+        return false;
+    }
+    return true;
+}
+
+void message_queue_finish(struct message_queue* queue){
+    if (queue->fd >= 0){
+        close(queue->fd);
+        queue->fd = -1;
+    }
+}
+
+bool message_send(struct message_queue* queue, enum message_type type){
+    return message_send_global(queue,type,0,0);
+}
+
+bool message_send_global(struct message_queue* queue, enum message_type type, uint32_t name, uint32_t version){
+    const uint32_t tail = atomic_load_explicit(&queue->tail,memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&queue->head,memory_order_acquire);
+    if (tail-head == MESSAGE_QUEUE_SIZE){
+        return false;
+    }
+    queue->messages[tail%MESSAGE_QUEUE_SIZE] = (struct message){type, name, version};
+    atomic_store_explicit(&queue->tail,tail+1,memory_order_release);
+    const uint64_t one = 1;
+    if (write(queue->fd,&one,sizeof(one)) < 0 && errno != EAGAIN){
+        fprintf(stderr,"Error signaling a message.\n");
+    }
+    return true;
+}
+
+void message_queue_clear(struct message_queue* queue){
+    uint64_t count;
+    if (read(queue->fd,&count,sizeof(count)) < 0 && errno != EAGAIN){
+        fprintf(stderr,"Error reading the message eventfd.\n");
+    }
+}
+
+bool message_receive(struct message_queue* queue, struct message* message){
+    const uint32_t head = atomic_load_explicit(&queue->head,memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&queue->tail,memory_order_acquire);
+    if (head == tail){
+        return false;
+    }
+    *message = queue->messages[head%MESSAGE_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head,head+1,memory_order_release);
+    return true;
+}
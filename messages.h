@@ -0,0 +1,52 @@
+#ifndef REGROW_MESSAGES_H
+#define REGROW_MESSAGES_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// power of two, far more than can pile up between two iterations of the receiving loop
+#define MESSAGE_QUEUE_SIZE 64
+
+enum message_type{
+    // main -> render thread: a key was pressed, the grown tree makes way for the next one
+    MESSAGE_SKIP,
+    // main -> render thread: the window is closed, stop drawing
+    MESSAGE_QUIT,
+    // render -> main thread: the compositor closed the toplevel or the render thread stopped on its own
+    MESSAGE_CLOSE,
+    // main -> render thread: a wl_output was announced, the render thread binds it on its own queue
+    MESSAGE_OUTPUT_ADDED,
+    // main -> render thread: a global was removed, it may be one of the outputs
+    MESSAGE_GLOBAL_REMOVED
+};
+
+// the only thing the threads tell each other, everything else belongs to one of them
+struct message{
+    enum message_type type;
+    // registry name and version of the global, only for MESSAGE_OUTPUT_ADDED and MESSAGE_GLOBAL_REMOVED
+    uint32_t name;
+    uint32_t version;
+};
+
+// lock free queue with exactly one thread sending and one receiving, the eventfd wakes the receiver's loop
+struct message_queue{
+    struct message messages[MESSAGE_QUEUE_SIZE];
+    // only written by the receiver
+    _Atomic uint32_t head;
+    // only written by the sender
+    _Atomic uint32_t tail;
+    int fd;
+};
+
+bool message_queue_init(struct message_queue* queue);
+void message_queue_finish(struct message_queue* queue);
+// returns false if the queue is full
+bool message_send(struct message_queue* queue, enum message_type type);
+bool message_send_global(struct message_queue* queue, enum message_type type, uint32_t name, uint32_t version);
+// resets the eventfd, the messages sent after that signal it again
+void message_queue_clear(struct message_queue* queue);
+// takes the oldest message, returns false if there's none
+bool message_receive(struct message_queue* queue, struct message* message);
+
+#endif
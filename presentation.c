@@ -0,0 +1,132 @@
+#include <string.h>
+#include "presentation.h"
+
+static void presentation_clock_id(void *data, struct wp_presentation *wp_presentation, uint32_t clk_id){
+    struct presentation* presentation = data;
+    presentation->clock = (clockid_t)clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+        .clock_id = presentation_clock_id
+};
+
+static void feedback_done(struct presentation_frame* frame){
+    wp_presentation_feedback_destroy(frame->feedback);
+    frame->feedback = NULL;
+}
+
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *wp_presentation_feedback, struct wl_output *output){
+
+}
+
+static void feedback_presented(void *data, struct wp_presentation_feedback *wp_presentation_feedback, uint32_t tv_sec_hi,
+                               uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags){
+    struct presentation_frame* frame = data;
+    struct presentation* presentation = frame->presentation;
+    const uint64_t time = ((uint64_t)tv_sec_hi<<32|tv_sec_lo)*1000000000ull+tv_nsec;
+    presentation->presented_time = time;
+    presentation->refresh = refresh;
+    presentation->sequence = (uint64_t)seq_hi<<32|seq_lo;
+    presentation->flags = flags;
+
+    presentation->presented++;
+    if (flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC){
+        presentation->vsync++;
+    }
+    if (flags & WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY){
+        presentation->zero_copy++;
+    }
+    // half a refresh of tolerance, the prediction and the timestamp aren't exact
+    if (frame->target != 0 && time > frame->target+refresh/2){
+        presentation->late++;
+    }
+    const uint64_t latency = time > frame->start ? time-frame->start : 0;
+    presentation->latency_sum += latency;
+    if (latency > presentation->latency_max){
+        presentation->latency_max = latency;
+    }
+    feedback_done(frame);
+}
+
+static void feedback_discarded(void *data, struct wp_presentation_feedback *wp_presentation_feedback){
+    struct presentation_frame* frame = data;
+    frame->presentation->discarded++;
+    feedback_done(frame);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+        .sync_output = feedback_sync_output,
+        .presented = feedback_presented,
+        .discarded = feedback_discarded
+};
+
+void presentation_init(struct presentation* presentation, struct wp_presentation* wp_presentation){
+    memset(presentation,0,sizeof(*presentation));
+    // the clock most compositors use, until clock_id says otherwise
+    presentation->clock = CLOCK_MONOTONIC;
+    presentation->wp_presentation = wp_presentation;
+    if (wp_presentation != NULL){
+        wp_presentation_add_listener(wp_presentation,&presentation_listener,presentation);
+    }
+}
+
+void presentation_finish(struct presentation* presentation){
+    for (int i = 0; i < PRESENTATION_MAX_PENDING; ++i) {
+        if (presentation->pending[i].feedback != NULL){
+            feedback_done(&presentation->pending[i]);
+        }
+    }
+    if (presentation->wp_presentation != NULL){
+        wp_presentation_destroy(presentation->wp_presentation);
+        presentation->wp_presentation = NULL;
+    }
+}
+
+uint64_t presentation_now(const struct presentation* presentation){
+    struct timespec ts;
+    clock_gettime(presentation->clock,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+uint64_t presentation_next_vblank(const struct presentation* presentation, uint64_t time){
+    if (presentation->refresh == 0 || presentation->presented_time == 0){
+        return 0;
+    }
+    if (time <= presentation->presented_time){
+        return presentation->presented_time;
+    }
+    // whole refreshes since the last presented frame, rounded up
+    const uint64_t refreshes = (time-presentation->presented_time+presentation->refresh-1)/presentation->refresh;
+    return presentation->presented_time+refreshes*presentation->refresh;
+}
+
+void presentation_frame_begin(struct presentation* presentation, uint64_t target){
+    presentation->next_start = presentation_now(presentation);
+    presentation->next_target = target;
+}
+
+void presentation_commit(struct presentation* presentation, struct wl_surface* surface){
+    if (presentation->wp_presentation == NULL){
+        return;
+    }
+    struct presentation_frame* frame = NULL;
+    for (int i = 0; i < PRESENTATION_MAX_PENDING && frame == NULL; ++i) {
+        if (presentation->pending[i].feedback == NULL){
+            frame = &presentation->pending[i];
+        }
+    }
+    // a commit without a frame that was started is measured from the commit itself
+    const uint64_t start = presentation->next_start != 0 ? presentation->next_start : presentation_now(presentation);
+    const uint64_t target = presentation->next_target;
+    presentation->next_start = 0;
+    presentation->next_target = 0;
+    if (frame == NULL){
+        presentation->dropped++;
+        return;
+    }
+    frame->presentation = presentation;
+    frame->start = start;
+    frame->target = target;
+    frame->feedback = wp_presentation_feedback(presentation->wp_presentation,surface);
+    wp_presentation_feedback_add_listener(frame->feedback,&feedback_listener,frame);
+}
@@ -0,0 +1,67 @@
+#ifndef REGROW_PRESENTATION_H
+#define REGROW_PRESENTATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <wayland-client.h>
+#include "presentation-time-client-protocol.h"
+
+// commits that can wait for their feedback at the same time, later ones don't get any
+#define PRESENTATION_MAX_PENDING 16
+
+struct presentation;
+
+// a commit waiting for its presented or discarded event
+struct presentation_frame{
+    struct presentation* presentation;
+    struct wp_presentation_feedback* feedback;
+    // when the work on the frame started, in ns of the presentation clock
+    uint64_t start;
+    // vblank the frame was drawn for, 0 if it wasn't known
+    uint64_t target;
+};
+
+// when the frames actually reached the screen, from wp_presentation
+struct presentation{
+    struct wp_presentation* wp_presentation;
+    clockid_t clock;
+    struct presentation_frame pending[PRESENTATION_MAX_PENDING];
+    // start and target of the frame that's committed next
+    uint64_t next_start;
+    uint64_t next_target;
+
+    // the last presented frame
+    uint64_t presented_time;
+    // ns between refreshes of the output, 0 if it doesn't refresh at a constant rate
+    uint32_t refresh;
+    uint64_t sequence;
+    uint32_t flags;
+
+    // statistics
+    uint64_t presented;
+    uint64_t discarded;
+    // presented after the vblank they were drawn for
+    uint64_t late;
+    uint64_t vsync;
+    uint64_t zero_copy;
+    // commits that got no feedback because too many were pending
+    uint64_t dropped;
+    // from the start of a frame until it was presented, in ns
+    uint64_t latency_sum;
+    uint64_t latency_max;
+};
+
+// wp_presentation may be NULL, then it only reads the clock and never predicts a vblank
+void presentation_init(struct presentation* presentation, struct wp_presentation* wp_presentation);
+void presentation_finish(struct presentation* presentation);
+// current time of the presentation clock in ns
+uint64_t presentation_now(const struct presentation* presentation);
+// the first vblank at or after the given time, 0 until the refresh rate is known
+uint64_t presentation_next_vblank(const struct presentation* presentation, uint64_t time);
+// the work on the next frame starts now, it should be on screen at target (0 if unknown)
+void presentation_frame_begin(struct presentation* presentation, uint64_t target);
+// requests the feedback for the content of the next commit of the surface
+void presentation_commit(struct presentation* presentation, struct wl_surface* surface);
+
+#endif
@@ -1,7 +1,12 @@
 #define _POSIX_C_SOURCE 200112L
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -12,15 +17,98 @@
 #include <wayland-cursor.h>
 #include "xdg-shell-client-protocol.h"
 #include "xdg-decoration-unstable-v1-client-protocol.h"
-#include <math.h>
+#include "viewporter-client-protocol.h"
+#include "single-pixel-buffer-v1-client-protocol.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "shm.h"
+#include "swapchain.h"
+#include "presentation.h"
+#include "timing.h"
+#include "trace.h"
+#include "log.h"
+#include "event_loop.h"
+#include "messages.h"
+#include "tree_worker.h"
+#include "reveal.h"
 #include <stdbool.h>
 #include <xkbcommon/xkbcommon.h>
 
+enum frame_state{
+    // waiting for the frame callback of the last commit
+    FRAME_SCHEDULED,
+    // the picture is static, nothing is committed until a timer, input or configure wakes it up
+    FRAME_IDLE
+};
+
+// what woke up an event loop besides the display, stored in epoll_event.data
+enum loop_source{
+    LOOP_TIMER = EVENT_LOOP_DISPLAY+1,
+    LOOP_SIGNAL,
+    LOOP_WORKER,
+    LOOP_MESSAGE
+};
+
+// button transitions one pointer frame can hold, the ones after that are dropped
+#define POINTER_FRAME_MAX_BUTTONS 8
+
+// which parts of a pointer frame were sent
+enum pointer_frame_event{
+    POINTER_FRAME_ENTER = 1<<0,
+    POINTER_FRAME_LEAVE = 1<<1,
+    POINTER_FRAME_MOTION = 1<<2,
+    POINTER_FRAME_BUTTON = 1<<3,
+    POINTER_FRAME_AXIS = 1<<4,
+    POINTER_FRAME_AXIS_SOURCE = 1<<5,
+    POINTER_FRAME_AXIS_STOP = 1<<6,
+    POINTER_FRAME_AXIS_VALUE120 = 1<<7
+};
+
+struct pointer_button{
+    uint32_t serial;
+    uint32_t button;
+    uint32_t state;
+};
+
+// the pointer events between two wl_pointer.frame events, they're all handled at once when it arrives
+struct pointer_frame{
+    // enum pointer_frame_event bits
+    uint32_t events;
+    // serial of the enter
+    uint32_t serial;
+    uint32_t time;
+    // only the last position counts
+    wl_fixed_t x;
+    wl_fixed_t y;
+    // summed per axis (WL_POINTER_AXIS_VERTICAL_SCROLL and HORIZONTAL_SCROLL)
+    wl_fixed_t axis[2];
+    int32_t axis_value120[2];
+    bool axis_stop[2];
+    uint32_t axis_source;
+    // in the order they happened, a click within one frame is a press and a release
+    struct pointer_button buttons[POINTER_FRAME_MAX_BUTTONS];
+    int button_count;
+};
+
+// outputs the render thread keeps track of, the ones beyond are ignored
+#define MAX_OUTPUTS 8
+
+// a wl_output bound on the render queue, only used by the render thread
+struct output{
+    struct wl_output* wl_output;
+    uint32_t name;
+    int32_t scale;
+    // applied with the next done event
+    int32_t pending_scale;
+    // the window is (partly) on it
+    bool entered;
+};
+
 struct client_state{
     struct wl_display *display;
     struct wl_registry *registry;
     struct wl_shm *shm;
     struct wl_compositor *compositor;
+    struct wl_subcompositor *wl_subcompositor;
     struct xdg_wm_base *xdg_wm_base;
     struct wl_seat *wl_seat;
 
@@ -29,131 +117,318 @@ struct client_state{
     struct xdg_toplevel *xdg_toplevel;
     struct zxdg_decoration_manager_v1 *zxdg_decoration_manager_v1;
     struct zxdg_toplevel_decoration_v1 *zxdg_toplevel_decoration_v1;
+    // both optional, without them the background needs a buffer of the window size
+    struct wp_viewporter *wp_viewporter;
+    struct wp_single_pixel_buffer_manager_v1 *wp_single_pixel_buffer_manager_v1;
+    struct wp_viewport *wp_viewport;
+    struct wp_fractional_scale_manager_v1 *wp_fractional_scale_manager_v1;
+    struct wp_fractional_scale_v1 *wp_fractional_scale_v1;
+    // layered mode: the tree is a subsurface above the background and the reveal only moves its viewport
+    bool layered;
+    struct wl_surface *tree_surface;
+    struct wl_subsurface *tree_subsurface;
+    struct wp_viewport *tree_viewport;
+    // the buffer the current tree was rasterized into is attached to tree_surface
+    bool tree_attached;
+    // first row the tree surface shows, height while it's hidden
+    uint16_t shownRow;
+    // statistics, every one is a tree the compositor uploads
+    uint64_t tree_attaches;
     struct wl_pointer *wl_pointer;
+    struct pointer_frame pointer_frame;
+    // statistics
+    uint64_t pointer_events;
+    uint64_t pointer_frames;
     struct wl_keyboard *wl_keyboard;
 
     uint8_t offset;
-    uint8_t step;
+    struct reveal reveal;
     uint16_t height_render;
     uint16_t width_render;
     uint16_t currentRow;
-    uint16_t tree_size;
-    uint16_t branch_width;
-    uint16_t tree_type;
+    // size of the buffers in pixels
     uint16_t width;
     uint16_t height;
+    // size of the window in surface coordinates, as configured
+    uint16_t surface_width;
+    uint16_t surface_height;
+    // preferred scale of the output in 1/120, from wp_fractional_scale_v1 or the integer buffer scale
+    uint32_t scale;
+    int32_t buffer_scale;
+    // fraction of the native resolution that's rendered, the viewport stretches it to the window
+    double render_scale;
     bool is_drawing;
+    // only used by the main thread, the render thread sends MESSAGE_CLOSE
     bool closed;
-
-    struct wl_buffer* treeBuffer;
-    struct wl_buffer* emptyBuffer;
+    // xdg_toplevel states of the last configure
+    bool suspended;
+    bool resizing;
+    bool activated;
+    // ms between frames while the window isn't activated, 0 keeps the full frame rate
+    int32_t inactive_interval;
+    // the window got its first buffer
+    bool mapped;
+    // a configure was acked but not applied yet
+    bool configure_pending;
+    // serial of the last configure, it's acked right before the commit that applies it
+    uint32_t configure_serial;
+    bool configure_unacked;
+    // the tree wasn't rasterized at the current size
+    bool tree_stale;
+
+    // a frame callback is only requested while something on screen changes
+    enum frame_state frame_state;
+    // the frame callback that was requested and didn't arrive yet, destroyed before the render queue
+    struct wl_callback* frame_callback;
+    // CLOCK_MONOTONIC time in ms at which an idle window wakes up again, -1 for never
+    int64_t wake_time;
+    int64_t idle_since;
+    // the window was idle until request_frame woke it up, the next commit still counts as an idle one
+    bool woke_up;
+    // only waiting for the next frame of a throttled animation, that's not idle
+    bool throttled;
+    // when the attach and damage for the next commit started (timing_now), 0 if it only commits
+    uint64_t attach_started;
+    // statistics
+    uint64_t commits;
+    // commits of a window that was idle before them, the wake ups are counted separately as well
+    uint64_t idle_commits;
+    uint64_t wake_ups;
+    // frames of a window in the background that were started by the timer, they're neither of the above
+    uint64_t throttled_frames;
+    int64_t idle_ms;
+
+    struct shm_pool* pool;
+    struct swapchain swapchain;
+    // when the commits were actually shown
+    struct presentation presentation;
+    // draws the next tree while the current one is revealed, the swapchain buffers get the part of
+    // worker.current that's currently visible
+    struct tree_worker worker;
+    // black background shown instead of the tree, a single pixel stretched by the viewport when it can be
+    struct wl_buffer* backgroundBuffer;
+    struct shm_buffer* emptyBuffer;
     struct wl_surface* wl_cursor_surface;
     struct wl_cursor_image* wl_cursor_image;
     struct xkb_state* xkb_state;
     struct xkb_context* xkb_context;
     struct xkb_keymap* xkb_keymap;
+
+    // the surfaces with their frame callbacks, configures and buffers are dispatched on the render thread,
+    // input and the registry on the main thread. Once it runs, the threads only talk through the messages.
+    struct wl_event_queue* render_queue;
+    // wrapper of the registry on the render queue, the outputs are bound with it
+    struct wl_registry* render_registry;
+    struct output outputs[MAX_OUTPUTS];
+    int output_count;
+    pthread_t render_thread;
+    struct message_queue to_render;
+    struct message_queue to_main;
 };
 
-static void randname(char *buf){
+static void xdg_wm_base_handle_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial){
+    xdg_wm_base_pong(xdg_wm_base,serial);
+}
+
+static const struct xdg_wm_base_listener xdg_wm_base_listener = {
+        .ping = xdg_wm_base_handle_ping
+};
+
+static const struct wl_callback_listener wl_surface_frame_listener;
+
+static int64_t now_ms(){
     struct timespec ts;
-    clock_gettime(CLOCK_REALTIME,&ts);
-    long r = ts.tv_nsec;
-    for (int i = 0; i < 6; ++i) {
-        buf[i] = 'A' + (r&15) + (r&16)*2;
-        r >>= 2;
-    }
-}
-
-static int create_shm_file(){
-    int retries = 100;
-    do{
-        char name[] = "/wl_shm-XXXXXX";
-        randname(name+ sizeof(name)-7);
-        retries--;
-        int fd = shm_open(name,O_RDWR | O_CREAT | O_EXCL, 0600);
-        if (fd >= 0){
-            if(shm_unlink(name) == 0) {
-                return fd;
-            }
-        }
-    } while (retries > 0 && errno == EEXIST);
-    return -1;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec*1000+ts.tv_nsec/1000000;
 }
 
-int allocate_shm_file(size_t size){
-    int fd = create_shm_file();
-    if (fd<0){
-        return -1;
+// the attach and damage of the next commit start now
+static void attach_start(struct client_state* state){
+    if (state->attach_started == 0){
+        state->attach_started = timing_now();
     }
-    int ret;
-    do {
-        ret = ftruncate(fd,size);
-    } while (ret<0 && errno == EINTR);
-    if (ret<0){
-        close(fd);
-        return -1;
+}
+
+static void commit(struct client_state* state){
+    const uint64_t span = trace_begin();
+    attach_start(state);
+    presentation_commit(&state->presentation,state->wl_surface);
+    wl_surface_commit(state->wl_surface);
+    timing_record(TIMING_COMMIT,state->attach_started);
+    trace_end("commit",span);
+    state->attach_started = 0;
+    state->commits++;
+    if (state->mapped && ((state->frame_state == FRAME_IDLE && !state->throttled) || state->woke_up)){
+        state->idle_commits++;
     }
-    return fd;
+    state->woke_up = false;
 }
 
-static void xdg_wm_base_handle_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial){
-    xdg_wm_base_pong(xdg_wm_base,serial);
+static void add_frame_callback(struct client_state* state){
+    if (state->frame_callback != NULL){
+        return;
+    }
+    state->frame_callback = wl_surface_frame(state->wl_surface);
+    wl_callback_add_listener(state->frame_callback,&wl_surface_frame_listener,state);
 }
 
-static const struct xdg_wm_base_listener xdg_wm_base_listener = {
-        .ping = xdg_wm_base_handle_ping
-};
+// asks for a frame callback with the next commit, the animation runs until it goes idle again
+static void request_frame(struct client_state* state){
+    if (state->frame_state == FRAME_SCHEDULED){
+        return;
+    }
+    // the commit that maps the window doesn't wake it up, it wasn't idle before
+    if (state->throttled){
+        state->throttled_frames++;
+    }else if (state->mapped){
+        state->idle_ms += now_ms()-state->idle_since;
+        state->wake_ups++;
+        state->woke_up = true;
+    }
+    state->throttled = false;
+    state->frame_state = FRAME_SCHEDULED;
+    state->wake_time = -1;
+    add_frame_callback(state);
+}
+
+// stops asking for frame callbacks, wake_in is the time in ms until it should wake up on its own (-1 = never)
+static void go_idle(struct client_state* state, int32_t wake_in){
+    if (state->frame_state != FRAME_IDLE){
+        state->frame_state = FRAME_IDLE;
+        state->idle_since = now_ms();
+    }
+    state->wake_time = wake_in < 0 ? -1 : now_ms()+wake_in;
+}
+
+// nothing is animated while the compositor doesn't show the window or it's being resized
+static bool animation_paused(struct client_state* state){
+    return state->suspended || state->resizing;
+}
+
+static void wake_up(struct client_state* state){
+    if (state->frame_state == FRAME_IDLE && !animation_paused(state)){
+        request_frame(state);
+        commit(state);
+    }
+}
 
 // event that's emitted when the cursor enters the surface
 void wl_pointer_enter_handle(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y){
     struct client_state *state = data;
-    wl_pointer_set_cursor(wl_pointer, serial, state->wl_cursor_surface, state->wl_cursor_image->hotspot_x, state->wl_cursor_image->hotspot_y);
-    printf("enter:\t%d %d\n",wl_fixed_to_int(surface_x),wl_fixed_to_int(surface_y));
+    struct pointer_frame* frame = &state->pointer_frame;
+    frame->events |= POINTER_FRAME_ENTER;
+    frame->serial = serial;
+    frame->x = surface_x;
+    frame->y = surface_y;
+    state->pointer_events++;
 }
 
 // event that's emitted when the cursor leaves the surface
 void wl_pointer_leave_handle(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface){
-    printf("Pointer left\n");
+    struct client_state *state = data;
+    state->pointer_frame.events |= POINTER_FRAME_LEAVE;
+    state->pointer_events++;
 }
 
 // event that's emitted when the cursor moves on the surface
 void wl_pointer_motion_handle(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y){
-    printf("Move:\t%d %d\n",wl_fixed_to_int(surface_x),wl_fixed_to_int(surface_y));
+    struct client_state *state = data;
+    struct pointer_frame* frame = &state->pointer_frame;
+    frame->events |= POINTER_FRAME_MOTION;
+    frame->time = time;
+    frame->x = surface_x;
+    frame->y = surface_y;
+    state->pointer_events++;
 }
 
 // event that's emitted when the pointer presses a button while on the surface(left click for example)
 void wl_pointer_button_handle(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state){
-    printf("button: 0x%x state: %d\n", button, state);
-    if (button == 0x110 && state == 1){
-        struct client_state* client_state = data;
-        xdg_toplevel_move(client_state->xdg_toplevel, client_state->wl_seat, serial);
+    struct client_state* client_state = data;
+    struct pointer_frame* frame = &client_state->pointer_frame;
+    frame->events |= POINTER_FRAME_BUTTON;
+    frame->time = time;
+    if (frame->button_count < POINTER_FRAME_MAX_BUTTONS){
+        frame->buttons[frame->button_count++] = (struct pointer_button){serial, button, state};
     }
+    client_state->pointer_events++;
 }
 
 // event that's emitted when the pointer scrolls by mouse wheel, touch pad, etc.
 void wl_pointer_axis_handle(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value){
-    printf("axis: %d %f\n", axis, wl_fixed_to_double(value));
+    struct client_state *state = data;
+    struct pointer_frame* frame = &state->pointer_frame;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL){
+        return;
+    }
+    frame->events |= POINTER_FRAME_AXIS;
+    frame->time = time;
+    frame->axis[axis] += value;
+    state->pointer_events++;
 }
 
 // event that indicates that all pointer events have been received for a given frame
 void wl_pointer_frame_handle(void *data, struct wl_pointer *wl_pointer){
-    // this is where all the past pointer event data should be processed
+    struct client_state *state = data;
+    struct pointer_frame* frame = &state->pointer_frame;
+    state->pointer_frames++;
+    trace_instant("pointer frame");
+    if (frame->events & POINTER_FRAME_ENTER){
+        wl_pointer_set_cursor(wl_pointer, frame->serial, state->wl_cursor_surface, state->wl_cursor_image->hotspot_x, state->wl_cursor_image->hotspot_y);
+        log_info("enter:\t%d %d\n",wl_fixed_to_int(frame->x),wl_fixed_to_int(frame->y));
+    }else if (frame->events & POINTER_FRAME_MOTION){
+        log_debug("Move:\t%d %d\n",wl_fixed_to_int(frame->x),wl_fixed_to_int(frame->y));
+    }
+    for (int i = 0; i < frame->button_count; ++i) {
+        const struct pointer_button* button = &frame->buttons[i];
+        log_info("button: 0x%x state: %d\n", button->button, button->state);
+        if (button->button == 0x110 && button->state == WL_POINTER_BUTTON_STATE_PRESSED){
+            xdg_toplevel_move(state->xdg_toplevel, state->wl_seat, button->serial);
+        }
+    }
+    if (frame->events & (POINTER_FRAME_AXIS|POINTER_FRAME_AXIS_VALUE120)){
+        log_debug("axis: %f %f (%d %d in 1/120 steps, source %d)\n", wl_fixed_to_double(frame->axis[WL_POINTER_AXIS_VERTICAL_SCROLL]),
+                  wl_fixed_to_double(frame->axis[WL_POINTER_AXIS_HORIZONTAL_SCROLL]), frame->axis_value120[WL_POINTER_AXIS_VERTICAL_SCROLL],
+                  frame->axis_value120[WL_POINTER_AXIS_HORIZONTAL_SCROLL], (int)frame->axis_source);
+    }
+    if (frame->events & POINTER_FRAME_AXIS_STOP){
+        log_debug("axis stop: %d %d\n", frame->axis_stop[WL_POINTER_AXIS_VERTICAL_SCROLL], frame->axis_stop[WL_POINTER_AXIS_HORIZONTAL_SCROLL]);
+    }
+    if (frame->events & POINTER_FRAME_LEAVE){
+        log_info("Pointer left\n");
+    }
+    memset(frame,0,sizeof(*frame));
 }
 
 void wl_pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source){
-
+    struct client_state *state = data;
+    state->pointer_frame.events |= POINTER_FRAME_AXIS_SOURCE;
+    state->pointer_frame.axis_source = axis_source;
+    state->pointer_events++;
 }
 
 void wl_pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis){
-
+    struct client_state *state = data;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL){
+        return;
+    }
+    state->pointer_frame.events |= POINTER_FRAME_AXIS_STOP;
+    state->pointer_frame.axis_stop[axis] = true;
+    state->pointer_events++;
 }
 
+// not sent since version 8, axis_value120 replaces it
 void wl_pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete){
 
 }
 
 void wl_pointer_axis_value120(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t value120){
-
+    struct client_state *state = data;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL){
+        return;
+    }
+    state->pointer_frame.events |= POINTER_FRAME_AXIS_VALUE120;
+    state->pointer_frame.axis_value120[axis] += value120;
+    state->pointer_events++;
 }
 
 static const struct wl_pointer_listener wl_pointer_listener = {
@@ -185,7 +460,7 @@ static void wl_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard, uint
     if (format==WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1){
         char* map_shm = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
         if (map_shm == MAP_FAILED){
-            printf("Error allocating shared memory.\n");
+            log_error("Error allocating shared memory.\n");
         }else{
             struct xkb_keymap* xkb_keymap = xkb_keymap_new_from_string(state->xkb_context, map_shm, format, XKB_KEYMAP_COMPILE_NO_FLAGS);
             munmap(map_shm,size);
@@ -198,39 +473,44 @@ static void wl_keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard, uint
             state->xkb_state = xkb_state;
         }
     }else{
-        printf("Wrong keymap format.\n");
+        log_error("Wrong keymap format.\n");
     }
 }
 
 static void wl_keyboard_enter(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface, struct wl_array *keys){
     struct client_state* state = data;
-    printf("Keyboard entered. Keys pressed:\n");
+    log_info("Keyboard entered. Keys pressed:\n");
     uint32_t* key;
     wl_array_for_each(key, keys){
         char buf[128];
+        char utf8[32];
         uint32_t keycode = *key + 8;
         xkb_keysym_t sym = xkb_state_key_get_one_sym(state->xkb_state, keycode);
         xkb_keysym_get_name(sym,buf,sizeof(buf));
-        printf("Sym: %-12s (%d), ",buf,sym);
-        xkb_state_key_get_utf8(state->xkb_state, keycode, buf, sizeof(buf));
-        printf("UTF-8: %s\n",buf);
+        xkb_state_key_get_utf8(state->xkb_state, keycode, utf8, sizeof(utf8));
+        log_info("Sym: %-12s (%d), UTF-8: %s\n",buf,sym,utf8);
     }
 }
 
 static void wl_keyboard_leave(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, struct wl_surface *surface){
-    printf("Keyboard left the surface.\n");
+    log_info("Keyboard left the surface.\n");
 }
 
 static void wl_keyboard_key(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t state){
+    const uint64_t span = trace_begin();
     struct client_state* client_state = data;
     char buf[128];
+    char utf8[32];
     uint32_t keycode = key + 8;
     xkb_keysym_t sym = xkb_state_key_get_one_sym(client_state->xkb_state, keycode);
     xkb_keysym_get_name(sym,buf,sizeof(buf));
     const char* action = state == WL_KEYBOARD_KEY_STATE_PRESSED ? "Pressed" : "Released";
-    printf("%s Sym: %-12s (%d), ",action,buf,sym);
-    xkb_state_key_get_utf8(client_state->xkb_state, keycode, buf, sizeof(buf));
-    printf("UTF-8: %s\n",buf);
+    xkb_state_key_get_utf8(client_state->xkb_state, keycode, utf8, sizeof(utf8));
+    log_info("%s Sym: %-12s (%d), UTF-8: %s\n",action,buf,sym,utf8);
+    if (state == WL_KEYBOARD_KEY_STATE_PRESSED && !message_send(&client_state->to_render,MESSAGE_SKIP)){
+        log_warn("The render thread is busy, the key is ignored\n");
+    }
+    trace_end("key",span);
 }
 
 static void wl_keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group){
@@ -266,6 +546,8 @@ void wl_seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabili
     }else if(!pointer_capability && state->wl_pointer != NULL){
         wl_pointer_release(state->wl_pointer);
         state->wl_pointer = NULL;
+        // a frame that was cut off is never finished
+        memset(&state->pointer_frame,0,sizeof(state->pointer_frame));
     }
     // keyboard setup/release
     if (keyboard_capability && state->wl_keyboard == NULL){
@@ -278,7 +560,7 @@ void wl_seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabili
 }
 
 void wl_seat_name(void *data, struct wl_seat *wl_seat, const char *name){
-    printf("Seat name: %s\n",name);
+    log_info("Seat name: %s\n",name);
 }
 
 static const struct wl_seat_listener wl_seat_listener = {
@@ -291,31 +573,48 @@ static void registry_handle_global(void *data, struct wl_registry *wl_registry,
 //    printf("Interface: %s, version: %d, name: %d\n",interface,version,name);
       struct client_state *state = data;
       if (strcmp(interface,wl_compositor_interface.name)==0){
-          state->compositor = wl_registry_bind(wl_registry,name,&wl_compositor_interface,5);
+          // version 6 sends the preferred buffer scale
+          state->compositor = wl_registry_bind(wl_registry,name,&wl_compositor_interface,version < 6 ? version : 6);
+      }
+      else if(strcmp(interface,wl_subcompositor_interface.name)==0){
+          state->wl_subcompositor = wl_registry_bind(wl_registry,name,&wl_subcompositor_interface,1);
       }
       else if(strcmp(interface,wl_shm_interface.name)==0){
           state->shm = wl_registry_bind(wl_registry,name,&wl_shm_interface,wl_shm_interface.version);
       }
       else if(strcmp(interface,xdg_wm_base_interface.name)==0){
-          state->xdg_wm_base = wl_registry_bind(wl_registry,name,&xdg_wm_base_interface,4);
+          state->xdg_wm_base = wl_registry_bind(wl_registry,name,&xdg_wm_base_interface,version < 6 ? version : 6);
           xdg_wm_base_add_listener(state->xdg_wm_base,&xdg_wm_base_listener,state);
       }else if(strcmp(interface, wl_seat_interface.name) == 0){
           state->wl_seat = wl_registry_bind(wl_registry, name, &wl_seat_interface, 8);
           wl_seat_add_listener(state->wl_seat, &wl_seat_listener, state);
       }else if(strcmp(interface, zxdg_decoration_manager_v1_interface.name)==0){
           state->zxdg_decoration_manager_v1 = wl_registry_bind(wl_registry, name, &zxdg_decoration_manager_v1_interface, zxdg_decoration_manager_v1_interface.version);
+      }else if(strcmp(interface, wp_viewporter_interface.name)==0){
+          state->wp_viewporter = wl_registry_bind(wl_registry, name, &wp_viewporter_interface, 1);
+      }else if(strcmp(interface, wp_presentation_interface.name)==0){
+          // the clock_id event is sent right away, it needs the listener before the next dispatch
+          presentation_init(&state->presentation,wl_registry_bind(wl_registry, name, &wp_presentation_interface, 1));
+      }else if(strcmp(interface, wp_fractional_scale_manager_v1_interface.name)==0){
+          state->wp_fractional_scale_manager_v1 = wl_registry_bind(wl_registry, name, &wp_fractional_scale_manager_v1_interface, 1);
+      }else if(strcmp(interface, wp_single_pixel_buffer_manager_v1_interface.name)==0){
+          state->wp_single_pixel_buffer_manager_v1 = wl_registry_bind(wl_registry, name, &wp_single_pixel_buffer_manager_v1_interface, 1);
+      }else if(strcmp(interface, wl_output_interface.name)==0){
+          // only the render thread needs the scale of the outputs, it binds them itself
+          if (!message_send_global(&state->to_render,MESSAGE_OUTPUT_ADDED,name,version)){
+              log_warn("The render thread is busy, output %u is ignored\n",name);
+          }
       }
 }
 
 
 // gets called when objects are removed
 static void registry_handle_global_remove(void *data, struct wl_registry *wl_registry, uint32_t name){
-    //TODO
-}
-
-// poziva se kada compositor vise ne koristi buffer
-static void wl_buffer_release(void *data, struct wl_buffer *wl_buffer){
-    //wl_buffer_destroy(wl_buffer);
+    struct client_state *state = data;
+    // the render thread drops it if it's one of the outputs
+    if (!message_send_global(&state->to_render,MESSAGE_GLOBAL_REMOVED,name,0)){
+        log_warn("The render thread is busy, the removal of global %u is ignored\n",name);
+    }
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -323,149 +622,484 @@ static const struct wl_registry_listener registry_listener = {
         .global_remove = registry_handle_global_remove
 };
 
-static const struct wl_buffer_listener buffer_listener = {
-        .release = wl_buffer_release
-};
+// rasterizes the skeleton of the current tree again, it's only generated once
+static void draw_frame(struct client_state *state){
+    const uint64_t span = trace_begin();
+    if (state->worker.current != NULL){
+        tree_frame_render(state->worker.current,state->width,state->height);
+    }
+    // in layered mode it may be in another buffer now
+    state->tree_attached = false;
+    trace_end("draw_frame",span);
+}
 
-void draw_tree_new(uint32_t* data, int position, uint16_t width, uint16_t height, uint16_t tree_size, uint16_t branch_width){
-    if (tree_size>20 && branch_width>20 && position-width*tree_size-width*50>0) {
-        for (int i = 0; i < tree_size; ++i) {
-            data[position] = 0xFFA52A2A;
-            position -= width;
+// part of the window the tree covers, empty without a tree
+static struct damage_rect tree_bounds(const struct tree_frame* tree){
+    if (tree == NULL){
+        return (struct damage_rect){0};
+    }
+    const struct clip_rect* bounds = &tree->bounds;
+    return (struct damage_rect){bounds->left, bounds->top, bounds->right-bounds->left, bounds->bottom-bounds->top};
+}
+
+// the tree is visible from currentRow down, everything above it is black
+static void paint_rect(struct client_state* state, struct swapchain_view* view, struct damage_rect rect){
+    const struct render_target* tree = state->worker.current ? state->worker.current->target : NULL;
+    // a tree that couldn't be drawn for this size is left out
+    const bool visible = tree != NULL && tree->width == state->width && tree->height == state->height;
+    for (int y = rect.y; y < rect.y+rect.height; ++y) {
+        uint32_t* row = view->data+(size_t)y*view->stride+rect.x;
+        if (y >= state->currentRow && visible){
+            memcpy(row,tree->data+(size_t)y*state->width+rect.x,rect.width*4);
+        }else{
+            memset(row,0,rect.width*4);
         }
-        for (int i = 0; i < branch_width; ++i) {
-            data[position - i - ((width) * (int) (50 * sin(i * 3.1414 / 180)))] = 0xFF00FF00;
-            data[position + i - ((width) * (int) (50 * sin(i * 3.1414 / 180)))] = 0xFF00FF00;
+    }
+}
+
+static void paint_frame(struct client_state* state, struct swapchain_view* view, const struct damage* damage){
+    for (int i = 0; i < damage->count; ++i) {
+        paint_rect(state,view,damage->rects[i]);
+    }
+}
+
+// draws the parts that changed in this frame straight into a live buffer and presents it
+static void present_frame(struct client_state* state, const struct damage* changed){
+    struct swapchain_view view;
+    const uint64_t span = trace_begin();
+    const uint64_t start = timing_now();
+    const bool acquired = swapchain_begin(&state->swapchain,&view);
+    timing_record(TIMING_SHM,start);
+    trace_end("swapchain_begin",span);
+    if (!acquired){
+        // every buffer is still read by the compositor, the damage stays queued for the next frame
+        for (int i = 0; i < changed->count; ++i) {
+            swapchain_damage(&state->swapchain,changed->rects[i]);
         }
-        tree_size-=tree_size/5;
-        branch_width/=2;
-        draw_tree_new(data,position,width,height,tree_size,branch_width);
+        return;
     }
+    // the buffer first has to catch up with the frames it missed since it was last shown
+    paint_frame(state,&view,&view.repair);
+    paint_frame(state,&view,changed);
+    for (int i = 0; i < changed->count; ++i) {
+        swapchain_view_damage(&state->swapchain,&view,changed->rects[i]);
+    }
+    attach_start(state);
+    swapchain_end(&state->swapchain,state->wl_surface,&view);
 }
 
-void draw_branches(uint32_t* data,int position, uint16_t* width, uint16_t* height, uint16_t* branch_size){
-    if (position>(*width)*(*branch_size)) {
-        for (int i = 0; i <(*branch_size); i++) {
-            data[position-((*width)*i)-i] = 0xFF00FF00;
-            data[position-((*width)*i)+i] = 0xFF00FF00;
+// with a viewport the background is a single black pixel, from the compositor if it can make one and
+// a 1x1 shm buffer otherwise. Without a viewport the empty buffer needs the size of the window and keeps
+// its memory as long as the window doesn't grow beyond it.
+static void create_empty_buffer(struct client_state* state){
+    if (state->wp_viewport != NULL && state->wp_single_pixel_buffer_manager_v1 != NULL){
+        if (state->backgroundBuffer == NULL){
+            state->backgroundBuffer = wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(state->wp_single_pixel_buffer_manager_v1,0,0,0,UINT32_MAX);
         }
-        draw_branches(data,position-((*width)*(*branch_size))-(*branch_size),width,height,branch_size);
-        draw_branches(data,position-((*width)*(*branch_size))+(*branch_size),width,height,branch_size);
+        return;
+    }
+    const uint16_t width = state->wp_viewport != NULL ? 1 : state->width;
+    const uint16_t height = state->wp_viewport != NULL ? 1 : state->height;
+    struct shm_buffer* buffer = state->emptyBuffer;
+    if (buffer != NULL && buffer->width == width && buffer->height == height){
+        return;
+    }
+    const uint64_t start = timing_now();
+    if (buffer == NULL || !shm_buffer_reshape(buffer,width,height)){
+        shm_pool_put_buffer(buffer);
+        buffer = shm_pool_get_buffer(state->pool,width,height);
     }
+    timing_record(TIMING_SHM,start);
+    trace_end("empty buffer",start);
+    if (buffer == NULL){
+        fprintf(stderr,"Error allocating the empty buffer.\n");
+        state->emptyBuffer = NULL;
+        return;
+    }
+    memset(shm_buffer_data(buffer),0,(size_t)buffer->stride*buffer->height);
+    state->emptyBuffer = buffer;
 }
 
-void draw_tree(uint32_t* data, uint16_t width, uint16_t height, uint16_t branch_size){
-    int position = width/2+width*(height-height/4);
-    branch_size=branch_size/2;
-    for (int i = height; i > height-height/4; i--) {
-        data[width/2+width*i]=0xFFA52A2A;
+// shows the black background over the whole window
+static void attach_background(struct client_state* state){
+    create_empty_buffer(state);
+    attach_start(state);
+    if (state->backgroundBuffer != NULL){
+        wl_surface_attach(state->wl_surface,state->backgroundBuffer,0,0);
+    }else{
+        shm_buffer_attach(state->wl_surface,state->emptyBuffer);
     }
-    draw_branches(data,position,&width,&height,&branch_size);
+    wl_surface_damage_buffer(state->wl_surface,0,0,INT32_MAX,INT32_MAX);
 }
 
-static void draw_frame(struct client_state *state){
-    // each pixel contains 4 bytes
-    const int stride = state->width*4;
-    // velicina buffera
-    const int shm_pool_size = state->height * stride;
-    int fd = allocate_shm_file(shm_pool_size);
-
-    // mmap vraca pointer na alociranu memoriju
-    uint32_t *pool_data = mmap(NULL,shm_pool_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
-    // struktura koja moze drzati buffere
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm,fd,shm_pool_size);
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,state->width,state->height,stride,WL_SHM_FORMAT_XRGB8888);
-
-    wl_shm_pool_destroy(pool);
-    close(fd);
-
-    int position;
-    int bar_size=128;
-    int offset = state->offset%bar_size;
-    // writing the "pixels"(bytes) to the buffer
-
-    if (state->tree_type==0) {
-        // draw tree
-        draw_tree(pool_data, state->width, state->height, state->branch_width);
+// in layered mode the worker rasterizes the trees straight into shm buffers, the tree surface shows the
+// one of the current tree. NULL if it couldn't be drawn for this size.
+static struct shm_buffer* tree_buffer(const struct client_state* state){
+    const struct tree_frame* tree = state->worker.current;
+    if (tree == NULL || tree->target->width != state->width || tree->target->height != state->height){
+        return NULL;
+    }
+    return ((struct shm_target*)tree->target)->buffer;
+}
+
+// crops the tree surface to the rows from currentRow down, returns false if that's what it already shows.
+// The subsurface is synchronized, so it changes together with the next commit of the window.
+static bool present_layers(struct client_state* state){
+    uint16_t row = state->currentRow < state->height ? state->currentRow : state->height;
+    struct shm_buffer* buffer = tree_buffer(state);
+    if (buffer == NULL){
+        // a tree that couldn't be drawn for this size is left out
+        row = state->height;
+    }
+    if (row == state->shownRow && (row == state->height || state->tree_attached)){
+        return false;
+    }
+    attach_start(state);
+    if (row == state->height){
+        // a surface without a buffer is hidden
+        wl_surface_attach(state->tree_surface,NULL,0,0);
+        state->tree_attached = false;
     }else{
-        //draw new tree
-        draw_tree_new(pool_data,state->width/2+state->width*(state->height-1),state->width,state->height,state->tree_size,state->branch_width);
-
-    }
-//    for (int y = 0; y < height; ++y) {
-//        for (int x = 0; x < width; ++x) {
-//            position = (x+y+offset)%bar_size;
-//            if(position<bar_size/4){
-//                pool_data[x+y*width]=0xFF000000;
-//            }
-//            else if(position<bar_size/2){
-//                pool_data[x+y*width]=0xFFFF0000;
-//            }
-//            else if(position<bar_size-bar_size/4){
-//                pool_data[x+y*width]=0xFF00FF00;
-//            }
-//            else{
-//                pool_data[x+y*width]=0xFF0000FF;
-//            }
-//        }
-//    }
-
-    munmap(pool_data,shm_pool_size);
-    wl_buffer_add_listener(buffer,&buffer_listener, NULL);
-    state->treeBuffer = buffer;
+        if (!state->tree_attached){
+            shm_buffer_attach(state->tree_surface,buffer);
+            wl_surface_damage_buffer(state->tree_surface,0,0,INT32_MAX,INT32_MAX);
+            state->tree_attached = true;
+            state->tree_attaches++;
+        }
+        // only the source rectangle and the position move, no pixels are drawn or sent. The source is
+        // in pixels of the buffer, the position and the destination in surface coordinates.
+        const int32_t top = (int32_t)row*state->surface_height/state->height;
+        wp_viewport_set_source(state->tree_viewport,wl_fixed_from_int(0),wl_fixed_from_int(row),
+                               wl_fixed_from_int(state->width),wl_fixed_from_int(state->height-row));
+        wp_viewport_set_destination(state->tree_viewport,state->surface_width,state->surface_height-top);
+        wl_subsurface_set_position(state->tree_subsurface,0,top);
+    }
+    wl_surface_commit(state->tree_surface);
+    state->shownRow = row;
+    return true;
 }
 
-static void create_empty_buffer(struct client_state* state){
-    // each pixel contains 4 bytes
-    const int stride = state->width*4;
-    // velicina buffera
-    const int shm_pool_size = state->height * stride;
-    // create a file with random name of given pool size filled with "0"
-    int fd = allocate_shm_file(shm_pool_size);
-
-    // mmap alocira memoriju i vraca pointer na nju
-    uint32_t *pool_data = mmap(NULL,shm_pool_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
-    // zatrazimo od compositora da sebi mapira istu memoriju kao i client. POOL NIJE BUFFER
-    struct wl_shm_pool *pool = wl_shm_create_pool(state->shm,fd,shm_pool_size);
-    // iz pool-a mozemo alocirati buffere zadane velicine koji pocinju sa zadanim offsetom u poolu i imaju zadani format
-    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,state->width,state->height,stride,WL_SHM_FORMAT_XRGB8888);
-
-    wl_shm_pool_destroy(pool);
-    close(fd);
-
-    munmap(pool_data,shm_pool_size);
-    wl_buffer_add_listener(buffer,&buffer_listener, NULL);
-    state->emptyBuffer = buffer;
+// resizes the buffers to the configured size and shows the next frame in them
+static void resize_window(struct client_state* state){
+    state->configure_pending = false;
+    const uint16_t previousHeight = state->swapchain.height;
+    swapchain_resize(&state->swapchain,state->width,state->height);
+    swapchain_reset(&state->swapchain);
+    if (state->wp_viewport != NULL){
+        // every buffer of the window is scaled to its size, whatever the scale and the render scale are
+        wp_viewport_set_destination(state->wp_viewport,state->surface_width,state->surface_height);
+    }else{
+        wl_surface_set_buffer_scale(state->wl_surface,state->buffer_scale);
+    }
+    if (state->layered){
+        // the background is stretched to the new size, the tree surface is placed over it
+        attach_background(state);
+    }
+    if (animation_paused(state)){
+        // rasterizing the tree for every step of an interactive resize (or for a window nobody sees) is
+        // wasted, it shows an empty frame until the resize is over
+        if (state->layered){
+            // a tree of the old size is hidden
+            present_layers(state);
+        }else{
+            attach_background(state);
+        }
+        state->tree_stale = true;
+        return;
+    }
+    if (state->tree_stale || previousHeight != state->height || state->worker.current == NULL
+        || state->worker.current->target->width != state->width){
+        // the same tree at the new size, its parameters aren't rolled again
+        draw_frame(state);
+        state->tree_stale = false;
+    }
+    // the reveal keeps going, so everything under the current line has to be drawn into the new buffer
+    if (previousHeight > 0){
+        state->currentRow = (uint32_t)state->currentRow*state->height/previousHeight;
+    }else{
+        state->currentRow = state->height;
+    }
+    if (state->layered){
+        present_layers(state);
+        return;
+    }
+    struct damage nothing;
+    damage_clear(&nothing);
+    // after the reset the repair region is the whole buffer
+    present_frame(state,&nothing);
 }
 
-void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial){
-    struct client_state *state = data;
-    printf("Width: %d, Height: %d\n",state->width, state->height);
-    //acknowledge that the next frame is ready
-    xdg_surface_ack_configure(state->xdg_surface,serial);
+// buffer size for the current window size and scale, returns false if it stays the same
+static bool update_buffer_size(struct client_state* state){
+    uint32_t width = state->surface_width;
+    uint32_t height = state->surface_height;
+    if (state->wp_viewport != NULL){
+        // the viewport stretches a buffer of any size over the window, so the scale can be a fraction
+        const double scale = state->scale/120.0*state->render_scale;
+        width = (uint32_t)lround(width*scale);
+        height = (uint32_t)lround(height*scale);
+    }else{
+        width *= state->buffer_scale;
+        height *= state->buffer_scale;
+    }
+    // trees are only generated up to TREE_MAX_SIZE, a bigger window gets a smaller buffer. Without a
+    // viewport it has to stay a multiple of the buffer scale.
+    const uint32_t multiple = state->wp_viewport != NULL ? 1 : state->buffer_scale;
+    width = width < 1 ? 1 : width > TREE_MAX_SIZE ? TREE_MAX_SIZE/multiple*multiple : width;
+    height = height < 1 ? 1 : height > TREE_MAX_SIZE ? TREE_MAX_SIZE/multiple*multiple : height;
+    if (width == state->width && height == state->height){
+        return false;
+    }
+    state->width = width;
+    state->height = height;
+    tree_worker_resize(&state->worker,width,height);
+    return true;
+}
 
-    wl_buffer_destroy(state->treeBuffer);
-    wl_buffer_destroy(state->emptyBuffer);
-    draw_frame(state);
-    create_empty_buffer(state);
-    wl_surface_attach(state->wl_surface,state->emptyBuffer,0,0);
-    wl_surface_commit(state->wl_surface);
+// a new scale is applied in the next frame, the same way as a configure
+static void scale_changed(struct client_state* state){
+    if (!update_buffer_size(state)){
+        return;
+    }
+    state->configure_pending = true;
+    if (state->mapped && state->frame_state == FRAME_IDLE){
+        request_frame(state);
+        commit(state);
+    }
+}
+
+static void wp_fractional_scale_preferred_scale(void *data, struct wp_fractional_scale_v1 *wp_fractional_scale_v1, uint32_t scale){
+    struct client_state* state = data;
+    state->scale = scale;
+    scale_changed(state);
+}
+
+static const struct wp_fractional_scale_v1_listener wp_fractional_scale_listener = {
+        .preferred_scale = wp_fractional_scale_preferred_scale
+};
+
+static struct output* find_output(struct client_state* state, struct wl_output* wl_output){
+    for (int i = 0; i < state->output_count; ++i) {
+        if (state->outputs[i].wl_output == wl_output){
+            return &state->outputs[i];
+        }
+    }
+    return NULL;
+}
+
+// without wl_compositor version 6 and wp_fractional_scale_v1 nothing tells the window its scale, it's
+// rendered at the highest scale of the outputs it's on
+static void output_scale_changed(struct client_state* state){
+    if (state->wp_fractional_scale_v1 != NULL || wl_proxy_get_version((struct wl_proxy*)state->compositor) >= 6){
+        return;
+    }
+    int32_t scale = 1;
+    for (int i = 0; i < state->output_count; ++i) {
+        if (state->outputs[i].entered && state->outputs[i].scale > scale){
+            scale = state->outputs[i].scale;
+        }
+    }
+    if (scale == state->buffer_scale){
+        return;
+    }
+    state->buffer_scale = scale;
+    state->scale = scale*120;
+    scale_changed(state);
+}
+
+static void wl_output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height,
+                               int32_t subpixel, const char *make, const char *model, int32_t transform){
+
+}
+
+static void wl_output_mode(void *data, struct wl_output *wl_output, uint32_t flags, int32_t width, int32_t height, int32_t refresh){
+
+}
+
+static void wl_output_scale(void *data, struct wl_output *wl_output, int32_t factor){
+    struct output* output = find_output(data,wl_output);
+    if (output != NULL){
+        output->pending_scale = factor > 0 ? factor : 1;
+    }
+}
+
+// the properties of an output change atomically with done
+static void wl_output_done(void *data, struct wl_output *wl_output){
+    struct client_state* state = data;
+    struct output* output = find_output(state,wl_output);
+    if (output == NULL || output->scale == output->pending_scale){
+        return;
+    }
+    output->scale = output->pending_scale;
+    if (output->entered){
+        output_scale_changed(state);
+    }
+}
+
+static const struct wl_output_listener wl_output_listener = {
+        .geometry = wl_output_geometry,
+        .mode = wl_output_mode,
+        .done = wl_output_done,
+        .scale = wl_output_scale
+};
+
+static void add_output(struct client_state* state, uint32_t name, uint32_t version){
+    if (state->output_count == MAX_OUTPUTS){
+        log_warn("More than %d outputs, output %u is ignored\n",MAX_OUTPUTS,name);
+        return;
+    }
+    struct output* output = &state->outputs[state->output_count++];
+    // version 2 has the scale, 3 the release request
+    output->wl_output = wl_registry_bind(state->render_registry,name,&wl_output_interface,version < 3 ? version : 3);
+    output->name = name;
+    output->scale = 1;
+    output->pending_scale = 1;
+    output->entered = false;
+    wl_output_add_listener(output->wl_output,&wl_output_listener,state);
+}
+
+static void destroy_output(struct output* output){
+    if (wl_proxy_get_version((struct wl_proxy*)output->wl_output) >= 3){
+        wl_output_release(output->wl_output);
+    }else{
+        wl_output_destroy(output->wl_output);
+    }
+}
+
+static void remove_output(struct client_state* state, uint32_t name){
+    for (int i = 0; i < state->output_count; ++i) {
+        if (state->outputs[i].name != name){
+            continue;
+        }
+        const bool entered = state->outputs[i].entered;
+        destroy_output(&state->outputs[i]);
+        state->outputs[i] = state->outputs[--state->output_count];
+        if (entered){
+            output_scale_changed(state);
+        }
+        return;
+    }
+}
+
+static void wl_surface_enter(void *data, struct wl_surface *wl_surface, struct wl_output *wl_output){
+    struct client_state* state = data;
+    struct output* output = find_output(state,wl_output);
+    if (output != NULL){
+        output->entered = true;
+        output_scale_changed(state);
+    }
+}
+
+static void wl_surface_leave(void *data, struct wl_surface *wl_surface, struct wl_output *wl_output){
+    struct client_state* state = data;
+    struct output* output = find_output(state,wl_output);
+    if (output != NULL){
+        output->entered = false;
+        output_scale_changed(state);
+    }
+}
+
+static void wl_surface_preferred_buffer_scale(void *data, struct wl_surface *wl_surface, int32_t factor){
+    struct client_state* state = data;
+    state->buffer_scale = factor > 0 ? factor : 1;
+    // the fractional scale is more precise, if there is one
+    if (state->wp_fractional_scale_v1 == NULL){
+        state->scale = state->buffer_scale*120;
+    }
+    scale_changed(state);
+}
+
+static void wl_surface_preferred_buffer_transform(void *data, struct wl_surface *wl_surface, uint32_t transform){
+
+}
+
+static const struct wl_surface_listener wl_surface_listener = {
+        .enter = wl_surface_enter,
+        .leave = wl_surface_leave,
+        .preferred_buffer_scale = wl_surface_preferred_buffer_scale,
+        .preferred_buffer_transform = wl_surface_preferred_buffer_transform
+};
+
+// applies the last configure, no matter how many arrived since the previous frame
+static void apply_configure(struct client_state* state){
+    const uint64_t span = trace_begin();
+    if (state->configure_unacked){
+        // the buffer of the next commit has the configured size, the older serials of a burst are skipped
+        xdg_surface_ack_configure(state->xdg_surface,state->configure_serial);
+        state->configure_unacked = false;
+    }
+    resize_window(state);
+    trace_end("apply_configure",span);
+}
+
+static void handle_configure(struct client_state* state, uint32_t serial){
+    log_info("Width: %d, Height: %d\n",state->width, state->height);
+    // acknowledged together with the frame that has the new size, not before
+    state->configure_serial = serial;
+    state->configure_unacked = true;
+    state->configure_pending = true;
+    if (!state->mapped){
+        // the window needs its first buffer before it gets any frame callbacks
+        apply_configure(state);
+        if (!animation_paused(state)){
+            request_frame(state);
+        }
+        commit(state);
+        // a paused window is idle from now on
+        state->mapped = true;
+        state->idle_since = now_ms();
+        return;
+    }
+    // a burst of configures (an interactive resize) is applied once, in the next frame callback. This commit
+    // only asks for the callback, it doesn't ack the configure yet.
+    if (state->frame_state == FRAME_IDLE){
+        request_frame(state);
+        commit(state);
+    }
+}
+
+void xdg_surface_handle_configure(void *data, struct xdg_surface *xdg_surface, uint32_t serial){
+    const uint64_t span = trace_begin();
+    handle_configure(data,serial);
+    trace_end("configure",span);
 }
 
 static const struct xdg_surface_listener surface_listener = {
         .configure = xdg_surface_handle_configure
 };
 
-static const struct wl_callback_listener wl_surface_frame_listener;
+static void handle_frame(struct client_state* state, struct wl_callback *wl_callback, uint32_t callback_data){
 
-void wl_surface_frame_done (void *data, struct wl_callback *wl_callback, uint32_t callback_data){
-    struct client_state *state = data;
-
-    // destroy and create a new listener for the next frame
+    // the next callback is only requested if the picture keeps changing
     wl_callback_destroy(wl_callback);
-    wl_callback = wl_surface_frame(state->wl_surface);
-    wl_callback_add_listener(wl_callback,&wl_surface_frame_listener,state);
+    state->frame_callback = NULL;
+    // the frame is drawn for the vblank it will be shown at, not for the moment the callback arrived.
+    // Without wp_presentation the time of the callback is all there is.
+    const uint64_t now = presentation_now(&state->presentation);
+    const uint64_t vblank = presentation_next_vblank(&state->presentation,now);
+    presentation_frame_begin(&state->presentation,vblank);
+    const uint32_t time = state->presentation.wp_presentation != NULL ? (uint32_t)((vblank != 0 ? vblank : now)/1000000) : callback_data;
+    if (state->configure_pending){
+        // this frame shows the new size, the reveal continues with the next one
+        apply_configure(state);
+        if (!animation_paused(state)){
+            add_frame_callback(state);
+        }
+        commit(state);
+        if (animation_paused(state)){
+            go_idle(state,-1);
+        }
+        return;
+    }
+    if (animation_paused(state)){
+        // the next configure wakes it up again
+        go_idle(state,-1);
+        return;
+    }
 
+    uint16_t previousRow = state->currentRow;
+    swapchain_next_frame(&state->swapchain);
+    state->is_drawing = state->reveal.phase == REVEAL_GROWING;
     if (state->is_drawing){
         state->offset++;
         if (state->height_render < state->height)
@@ -473,27 +1107,64 @@ void wl_surface_frame_done (void *data, struct wl_callback *wl_callback, uint32_
         if (state->width_render < state->width)
             state->width_render++;
     }
-    if (state->is_drawing && state->currentRow-state->step > 0) {
-        state->currentRow -= state->step;
-        wl_surface_attach(state->wl_surface,state->treeBuffer,0,0);
-    }else{
-        state->is_drawing=false;
-        state->currentRow += state->step;
-        if (state->currentRow==state->height){
-            wl_buffer_destroy(state->treeBuffer);
-            state->is_drawing=true;
-            state->branch_width=rand()%(state->width/2)+50;
-            state->tree_size=rand()%(state->height/2)+100;
-            state->tree_type=rand()%2;
-            draw_frame(state);
-            wl_surface_attach(state->wl_surface,state->treeBuffer,0,0);
-        }else{
-            wl_surface_attach(state->wl_surface,state->emptyBuffer,0,0);
+    state->currentRow = reveal_update(&state->reveal,time,state->height);
+    bool newTree = false;
+    const struct damage_rect previousBounds = tree_bounds(state->worker.current);
+    if (state->reveal.phase == REVEAL_DONE){
+        // the worker has had the whole animation to draw the next tree, this only swaps pointers.
+        // If it's not finished yet, the window stays empty until the next frame.
+        if (tree_worker_next(&state->worker,false)){
+            reveal_restart(&state->reveal);
+            state->currentRow = reveal_update(&state->reveal,time,state->height);
+            state->tree_attached = false;
+            newTree = true;
         }
     }
-    //struct wl_buffer *buffer = draw_frame(state);
-    wl_surface_damage_buffer(state->wl_surface,0,state->currentRow,state->width,1);
-    wl_surface_commit(state->wl_surface);
+    // rows between the previous and the current line changed, with a new tree also everything below them
+    int first = previousRow < state->currentRow ? previousRow : state->currentRow;
+    int last = previousRow < state->currentRow ? state->currentRow : previousRow;
+    if (newTree || last > state->height){
+        last = state->height;
+    }
+    // only the pixels of the tree can change there, the black around it stays black
+    struct damage_rect span = {0,first,state->width,last-first};
+    struct damage changed;
+    damage_clear(&changed);
+    damage_add(&changed,damage_rect_intersect(span,tree_bounds(state->worker.current)));
+    if (newTree){
+        damage_add(&changed,damage_rect_intersect(span,previousBounds));
+    }
+    // nothing moved, the buffer on screen is still correct
+    bool presented = false;
+    if (state->layered){
+        presented = present_layers(state);
+    }else if (!damage_is_empty(&changed)){
+        present_frame(state,&changed);
+        presented = true;
+    }
+    int32_t time_left = reveal_time_left(&state->reveal,time);
+    // a window in the background keeps animating, just with fewer frames
+    state->throttled = time_left == 0 && !state->activated && state->inactive_interval > 0;
+    if (state->throttled){
+        time_left = state->inactive_interval;
+    }
+    if (time_left == 0){
+        add_frame_callback(state);
+    }
+    if (presented || time_left == 0){
+        commit(state);
+    }
+    if (time_left != 0){
+        // holding the grown tree or throttled, -1 waits for the worker's eventfd to finish the next tree
+        go_idle(state,time_left);
+    }
+}
+
+void wl_surface_frame_done (void *data, struct wl_callback *wl_callback, uint32_t callback_data){
+    const uint64_t start = timing_now();
+    handle_frame(data,wl_callback,callback_data);
+    timing_record(TIMING_FRAME_CALLBACK,start);
+    trace_end("frame callback",start);
 }
 
 static const struct wl_callback_listener wl_surface_frame_listener = {
@@ -502,13 +1173,29 @@ static const struct wl_callback_listener wl_surface_frame_listener = {
 
 static void xdg_toplevel_configure(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height, struct wl_array *states){
     struct client_state* state = data;
+    state->suspended = false;
+    state->resizing = false;
+    state->activated = false;
+    uint32_t* toplevel_state;
+    wl_array_for_each(toplevel_state, states){
+        switch (*toplevel_state){
+            case XDG_TOPLEVEL_STATE_SUSPENDED:
+                state->suspended = true;
+                break;
+            case XDG_TOPLEVEL_STATE_RESIZING:
+                state->resizing = true;
+                break;
+            case XDG_TOPLEVEL_STATE_ACTIVATED:
+                state->activated = true;
+                break;
+        }
+    }
     if (width == 0 || height == 0){
         return;
     }
-    state->width = width;
-    state->height = height;
-    state->currentRow = height;
-    state->is_drawing = true;
+    state->surface_width = width;
+    state->surface_height = height;
+    update_buffer_size(state);
 }
 
 static void xdg_toplevel_configure_bounds(void *data, struct xdg_toplevel *xdg_toplevel, int32_t width, int32_t height){
@@ -517,7 +1204,7 @@ static void xdg_toplevel_configure_bounds(void *data, struct xdg_toplevel *xdg_t
 
 static void xdg_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel){
     struct client_state* state = data;
-    state->closed = true;
+    message_send(&state->to_main,MESSAGE_CLOSE);
 }
 
 static void xdg_toplevel_wm_capabilities(void *data, struct xdg_toplevel *xdg_toplevel, struct wl_array *capabilities){
@@ -537,21 +1224,279 @@ static const struct xdg_toplevel_listener xdg_toplevel_listener = {
 // up - loads a buffer with the tree
 // down - loads an empty buffer to overwrite/delete the tree
 
-// TODO: kada se window resizea potrebno je ponovno renderati sve ispod trenutne linije zbog novog buffer-a
+// renders trees without a compositor, used for profiling and regression tests on machines without a display
+static int run_headless(int argc, char *argv[]){
+    int count = 1;
+    uint16_t width = 640;
+    uint16_t height = 480;
+    const char* output = NULL;
+    enum image_format format = IMAGE_FORMAT_PPM;
+    unsigned int seed = time(NULL);
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i],"--headless") == 0 && i+1 < argc && argv[i+1][0] != '-'){
+            count = atoi(argv[++i]);
+        }else if (strcmp(argv[i],"--size") == 0 && i+1 < argc){
+            unsigned int w, h;
+            if (sscanf(argv[++i],"%ux%u",&w,&h) != 2 || w < 2 || h < 2 || w > TREE_MAX_SIZE || h > TREE_MAX_SIZE){
+                fprintf(stderr,"Error: --size needs WIDTHxHEIGHT between 2x2 and %dx%d.\n",TREE_MAX_SIZE,TREE_MAX_SIZE);
+                return -1;
+            }
+            width = w;
+            height = h;
+        }else if (strcmp(argv[i],"--output") == 0 && i+1 < argc){
+            output = argv[++i];
+        }else if (strcmp(argv[i],"--pam") == 0){
+            format = IMAGE_FORMAT_PAM;
+        }else if (strcmp(argv[i],"--seed") == 0 && i+1 < argc){
+            seed = strtoul(argv[++i],NULL,10);
+        }
+    }
+    srand(seed);
+
+    struct memory_target* target = memory_target_create(output,format);
+    if (target == NULL){
+        fprintf(stderr,"Error creating the render target!\n");
+        return -1;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    for (int i = 0; i < count; ++i) {
+        struct tree_params params = tree_params_random(width,height);
+        if (!render_tree(&target->base,width,height,&params)){
+            fprintf(stderr,"Error allocating the tree buffer.\n");
+            render_target_destroy(&target->base);
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC,&end);
+    double ms = (end.tv_sec-start.tv_sec)*1e3+(end.tv_nsec-start.tv_nsec)/1e6;
+    printf("Rendered %d trees (%dx%d, seed %u) in %.3f ms\n",count,width,height,seed,ms);
+    render_target_destroy(&target->base);
+    return 0;
+}
+
+// arms the timer for the absolute time in ms (-1 = never), it's only changed when the time does
+static void arm_timer(int timer_fd, int64_t wake_time, int64_t* armed){
+    if (wake_time == *armed){
+        return;
+    }
+    // an all zero it_value disarms it
+    struct itimerspec spec = {0};
+    if (wake_time >= 0){
+        spec.it_value.tv_sec = wake_time/1000;
+        spec.it_value.tv_nsec = (wake_time%1000)*1000000;
+    }
+    if (timerfd_settime(timer_fd,TFD_TIMER_ABSTIME,&spec,NULL) == -1){
+        fprintf(stderr,"Error arming the timer.\n");
+        return;
+    }
+    *armed = wake_time;
+}
+
+static void handle_timer(struct client_state* state, int timer_fd, int64_t* armed){
+    uint64_t expirations;
+    if (read(timer_fd,&expirations,sizeof(expirations)) > 0){
+        // the timer was armed for this wake time, a wake_time set during dispatch re-arms it
+        *armed = -1;
+    }
+    if (state->wake_time >= 0 && now_ms() >= state->wake_time){
+        // a paused window would otherwise find the expired time again in every iteration
+        state->wake_time = -1;
+        wake_up(state);
+    }
+}
+
+// returns false once the render thread should stop
+static bool handle_render_messages(struct client_state* state){
+    message_queue_clear(&state->to_render);
+    bool running = true;
+    struct message message;
+    while (message_receive(&state->to_render,&message)){
+        switch (message.type){
+            case MESSAGE_SKIP:
+                if (state->reveal.phase == REVEAL_HOLDING){
+                    reveal_skip(&state->reveal);
+                    wake_up(state);
+                }
+                break;
+            case MESSAGE_QUIT:
+                running = false;
+                break;
+            case MESSAGE_OUTPUT_ADDED:
+                add_output(state,message.name,message.version);
+                break;
+            case MESSAGE_GLOBAL_REMOVED:
+                remove_output(state,message.name);
+                break;
+            default:
+                break;
+        }
+    }
+    return running;
+}
+
+// dispatches the render queue and draws every frame, so a slow frame never holds up the input
+static void* render_thread_run(void* data){
+    struct client_state* state = data;
+    trace_thread_name("render");
+    // the window sleeps until the display, the wake up timer, a finished tree or a message wakes it up
+    struct event_loop loop;
+    bool running = event_loop_init(&loop,state->display,state->render_queue);
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC,TFD_CLOEXEC|TFD_NONBLOCK);
+    running = running && timer_fd != -1 && event_loop_add(&loop,timer_fd,LOOP_TIMER)
+              && event_loop_add(&loop,state->worker.ready_fd,LOOP_WORKER)
+              && event_loop_add(&loop,state->to_render.fd,LOOP_MESSAGE);
+    if (!running){
+        fprintf(stderr,"Error starting the render loop.\n");
+    }
+    // the outputs announced during startup are bound before the window is mapped, so it gets their enter
+    running = running && handle_render_messages(state);
+    int64_t armed_time = -1;
+    while (running){
+        if (!event_loop_prepare(&loop)){
+            break;
+        }
+        arm_timer(timer_fd,state->wake_time,&armed_time);
+        // only the wait for a frame callback is time spent on the compositor, an idle window waits for nothing
+        loop.timed = state->frame_state == FRAME_SCHEDULED;
+        struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+        const int count = event_loop_wait(&loop,events);
+        if (count < 0){
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            switch (events[i].data.u32){
+                case LOOP_TIMER:
+                    handle_timer(state,timer_fd,&armed_time);
+                    break;
+                case LOOP_WORKER:
+                    tree_worker_clear_ready(&state->worker);
+                    // only an empty window is waiting for the tree, otherwise it's taken once the reveal is done
+                    if (state->reveal.phase == REVEAL_DONE){
+                        wake_up(state);
+                    }
+                    break;
+                case LOOP_MESSAGE:
+                    running = handle_render_messages(state) && running;
+                    break;
+            }
+        }
+    }
+    if (state->frame_state == FRAME_IDLE && !state->throttled){
+        state->idle_ms += now_ms()-state->idle_since;
+    }
+    if (timer_fd != -1){
+        close(timer_fd);
+    }
+    event_loop_finish(&loop);
+    // the main thread stops too if this one stopped on its own
+    message_send(&state->to_main,MESSAGE_CLOSE);
+    return NULL;
+}
+
+// SIGINT and SIGTERM close the window cleanly, SIGUSR1 prints the frame timings without stopping it
+static bool handle_signals(struct client_state* state, int signal_fd){
+    struct signalfd_siginfo info;
+    while (read(signal_fd,&info,sizeof(info)) == sizeof(info)){
+        if (info.ssi_signo == SIGUSR1){
+            timing_report(stdout);
+        }else{
+            log_info("Signal %d, closing the window\n",(int)info.ssi_signo);
+            state->closed = true;
+        }
+    }
+    return errno == EAGAIN;
+}
+
+// returns false once the window should close
+static bool handle_main_messages(struct client_state* state){
+    message_queue_clear(&state->to_main);
+    bool open = true;
+    struct message message;
+    while (message_receive(&state->to_main,&message)){
+        if (message.type == MESSAGE_CLOSE){
+            open = false;
+        }
+    }
+    return open;
+}
+
 int main(int argc, char *argv[]){
+    bool headless = false;
+    bool layers = true;
+    double render_scale = 1.0;
+    const char* trace_path = NULL;
+    uint32_t reveal_duration = REVEAL_DURATION_DEFAULT;
+    uint32_t reveal_hold = REVEAL_HOLD_DEFAULT;
+    int32_t inactive_interval = 0;
+    enum reveal_easing easing = REVEAL_EASING_LINEAR;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i],"--headless") == 0){
+            headless = true;
+        }else if (strcmp(argv[i],"--reveal-duration") == 0 && i+1 < argc){
+            reveal_duration = strtoul(argv[++i],NULL,10);
+        }else if (strcmp(argv[i],"--inactive-fps") == 0 && i+1 < argc){
+            int fps = atoi(argv[++i]);
+            inactive_interval = fps > 0 ? 1000/fps : 0;
+        }else if (strcmp(argv[i],"--hold") == 0 && i+1 < argc){
+            reveal_hold = strtoul(argv[++i],NULL,10);
+        }else if (strcmp(argv[i],"--easing") == 0 && i+1 < argc){
+            if (!reveal_parse_easing(argv[++i],&easing)){
+                fprintf(stderr,"Error: unknown easing %s, expected linear, smooth or cubic.\n",argv[i]);
+                return -1;
+            }
+        }else if (strcmp(argv[i],"--render-scale") == 0 && i+1 < argc){
+            render_scale = strtod(argv[++i],NULL);
+            if (render_scale <= 0 || render_scale > 1){
+                fprintf(stderr,"Error: the render scale has to be in (0, 1].\n");
+                return -1;
+            }
+        }else if (strcmp(argv[i],"--trace") == 0 && i+1 < argc){
+            trace_path = argv[++i];
+        }else if (strcmp(argv[i],"--no-layers") == 0){
+            layers = false;
+        }else if (strcmp(argv[i],"--branch-budget") == 0 && i+1 < argc){
+            set_branch_budget(strtoul(argv[++i],NULL,10));
+        }
+    }
+    if (headless){
+        return run_headless(argc,argv);
+    }
+    // blocked before any thread starts, so they're only delivered through the signalfd of the event loop
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals,SIGINT);
+    sigaddset(&signals,SIGTERM);
+    sigaddset(&signals,SIGUSR1);
+    if (sigprocmask(SIG_BLOCK,&signals,NULL) == -1){
+        fprintf(stderr,"Error blocking the signals!\n");
+        return -1;
+    }
+    // the handlers only queue their messages, a separate thread formats and prints them
+    log_start();
+    if (trace_path != NULL){
+        if (!trace_start(trace_path)){
+            return -1;
+        }
+        trace_thread_name("main");
+    }
     srand(time(NULL));
     struct client_state state = {0};
     state.width=640;
     state.height=480;
+    state.surface_width=state.width;
+    state.surface_height=state.height;
+    state.scale=120;
+    state.buffer_scale=1;
+    state.render_scale=render_scale;
     state.height_render=0;
     state.width_render=0;
     state.offset=0;
-    state.branch_width=rand()%(state.width/2)+50;
-    state.tree_size=rand()%(state.height/2)+100;
-    state.tree_type=rand()%2;
     state.is_drawing=true;
-    state.currentRow=state.width;
-    state.step = 5;
+    state.currentRow=state.height;
+    reveal_init(&state.reveal,reveal_duration,reveal_hold,easing);
+    state.activated = true;
+    state.inactive_interval = inactive_interval;
     state.xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
     // connects the display with the given name(NULL=regrow-0)
     state.display = wl_display_connect(NULL);
@@ -559,20 +1504,87 @@ int main(int argc, char *argv[]){
         fprintf(stderr,"Error!\n");
         return -1;
     }
-    fprintf(stdout,"Connected!\n");
+    log_info("Connected!\n");
+    // the registry already sends messages to the render thread
+    if (!message_queue_init(&state.to_render) || !message_queue_init(&state.to_main)){
+        return -1;
+    }
 
     state.registry = wl_display_get_registry(state.display);
+    presentation_init(&state.presentation,NULL);
     wl_registry_add_listener(state.registry,&registry_listener,&state);
-    // waits until pending requests and events are processed
+    // waits until pending requests and events are processed, the second one gets the events the globals send
+    // as soon as they're bound (the clock of wp_presentation), so they're all handled before the render thread runs
+    wl_display_roundtrip(state.display);
     wl_display_roundtrip(state.display);
+    // everything created from these proxies inherits the render queue: the shm buffers, the presentation
+    // feedback, the single pixel buffer and the fractional scale of the window
+    state.render_queue = wl_display_create_queue(state.display);
+    if (state.presentation.wp_presentation != NULL){
+        wl_proxy_set_queue((struct wl_proxy*)state.presentation.wp_presentation,state.render_queue);
+    }
+    if (state.wp_fractional_scale_manager_v1 != NULL){
+        wl_proxy_set_queue((struct wl_proxy*)state.wp_fractional_scale_manager_v1,state.render_queue);
+    }
+    if (state.wp_single_pixel_buffer_manager_v1 != NULL){
+        wl_proxy_set_queue((struct wl_proxy*)state.wp_single_pixel_buffer_manager_v1,state.render_queue);
+    }
+    // the outputs are bound by the render thread, their events go straight to its queue
+    state.render_registry = wl_proxy_create_wrapper(state.registry);
+    wl_proxy_set_queue((struct wl_proxy*)state.render_registry,state.render_queue);
+
+    // one pool per window, big enough for the empty buffer and a double buffered swapchain
+    state.pool = shm_pool_create(state.shm,(size_t)state.width*state.height*4*3);
+    if (!state.pool){
+        fprintf(stderr,"Error creating the shm pool!\n");
+        return -1;
+    }
+    wl_proxy_set_queue((struct wl_proxy*)state.pool->wl_shm_pool,state.render_queue);
+    swapchain_init(&state.swapchain,state.pool,SWAPCHAIN_MAX_BUFFERS);
+    const bool layered = layers && state.wl_subcompositor != NULL && state.wp_viewporter != NULL;
+    // in layered mode the worker rasterizes the trees straight into buffers the tree surface shows
+    if (!tree_worker_start(&state.worker,state.width,state.height,rand(),layered ? state.pool : NULL)){
+        fprintf(stderr,"Error starting the tree worker!\n");
+        return -1;
+    }
+    swapchain_resize(&state.swapchain,state.width,state.height);
 
-    // initialize default buffers
-    create_empty_buffer(&state);
-    draw_frame(&state);
+    tree_worker_next(&state.worker,true);
 
     state.wl_surface = wl_compositor_create_surface(state.compositor);
+    // its frame callbacks inherit the queue
+    wl_proxy_set_queue((struct wl_proxy*)state.wl_surface,state.render_queue);
+    if (state.wp_viewporter != NULL){
+        state.wp_viewport = wp_viewporter_get_viewport(state.wp_viewporter,state.wl_surface);
+        if (state.wp_fractional_scale_manager_v1 != NULL){
+            state.wp_fractional_scale_v1 = wp_fractional_scale_manager_v1_get_fractional_scale(state.wp_fractional_scale_manager_v1,state.wl_surface);
+            wp_fractional_scale_v1_add_listener(state.wp_fractional_scale_v1,&wp_fractional_scale_listener,&state);
+        }
+    }else if (render_scale != 1.0){
+        log_warn("No wp_viewporter, the render scale is ignored\n");
+    }
+    wl_surface_add_listener(state.wl_surface,&wl_surface_listener,&state);
+    update_buffer_size(&state);
+    if (layered){
+        state.tree_surface = wl_compositor_create_surface(state.compositor);
+        wl_proxy_set_queue((struct wl_proxy*)state.tree_surface,state.render_queue);
+        state.tree_subsurface = wl_subcompositor_get_subsurface(state.wl_subcompositor,state.tree_surface,state.wl_surface);
+        state.tree_viewport = wp_viewporter_get_viewport(state.wp_viewporter,state.tree_surface);
+        // pointer events keep going to the window itself
+        struct wl_region* region = wl_compositor_create_region(state.compositor);
+        wl_surface_set_input_region(state.tree_surface,region);
+        wl_region_destroy(region);
+        state.shownRow = state.height;
+        state.layered = true;
+    }else if (layers){
+        log_info("No wl_subcompositor or wp_viewporter, the reveal is drawn into whole buffers\n");
+    }
+    // initialize default buffers, the background depends on the viewport
+    create_empty_buffer(&state);
 
     state.xdg_surface = xdg_wm_base_get_xdg_surface(state.xdg_wm_base,state.wl_surface);
+    // and so does the toplevel, the configures are applied where the frames are drawn
+    wl_proxy_set_queue((struct wl_proxy*)state.xdg_surface,state.render_queue);
     xdg_surface_add_listener(state.xdg_surface, &surface_listener,&state);
     state.xdg_toplevel = xdg_surface_get_toplevel(state.xdg_surface);
     xdg_toplevel_add_listener(state.xdg_toplevel, &xdg_toplevel_listener, &state);
@@ -581,18 +1593,113 @@ int main(int argc, char *argv[]){
     state.zxdg_toplevel_decoration_v1 = zxdg_decoration_manager_v1_get_toplevel_decoration(state.zxdg_decoration_manager_v1, state.xdg_toplevel);
     zxdg_toplevel_decoration_v1_set_mode(state.zxdg_toplevel_decoration_v1, ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
 
+    // the first configure starts the animation
+    state.frame_state = FRAME_IDLE;
+    state.wake_time = -1;
+    state.idle_since = now_ms();
     wl_surface_commit(state.wl_surface);
 
-    struct wl_callback *wl_callback = wl_surface_frame(state.wl_surface);
-    wl_callback_add_listener(wl_callback,&wl_surface_frame_listener,&state);
+    if (pthread_create(&state.render_thread,NULL,render_thread_run,&state) != 0){
+        fprintf(stderr,"Error starting the render thread!\n");
+        return -1;
+    }
 
-    // waits until a server sends an event
-    while(wl_display_dispatch(state.display) != -1){
-        // code that executes after an event is processed
-        if (state.closed){
+    // the main thread only waits for input, the registry, signals and the messages of the render thread
+    struct event_loop loop;
+    const int signal_fd = signalfd(-1,&signals,SFD_CLOEXEC|SFD_NONBLOCK);
+    if (!event_loop_init(&loop,state.display,NULL) || signal_fd == -1 || !event_loop_add(&loop,signal_fd,LOOP_SIGNAL)
+        || !event_loop_add(&loop,state.to_main.fd,LOOP_MESSAGE)){
+        fprintf(stderr,"Error creating the event loop!\n");
+        state.closed = true;
+    }
+    while(!state.closed){
+        if (!event_loop_prepare(&loop)){
             break;
         }
+        struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+        const int count = event_loop_wait(&loop,events);
+        if (count < 0){
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.u32 == LOOP_SIGNAL && !handle_signals(&state,signal_fd)){
+                state.closed = true;
+            }else if (events[i].data.u32 == LOOP_MESSAGE && !handle_main_messages(&state)){
+                state.closed = true;
+            }
+        }
+    }
+    message_send(&state.to_render,MESSAGE_QUIT);
+    pthread_join(state.render_thread,NULL);
+    event_loop_finish(&loop);
+    if (signal_fd != -1){
+        close(signal_fd);
+    }
+    message_queue_finish(&state.to_render);
+    message_queue_finish(&state.to_main);
+    // the queued messages come before the statistics
+    log_stop();
+    printf("Swapchain: %llu buffers acquired, starved %llu times, %llu replaced after a resize, %llu pixels damaged\n",(unsigned long long)state.swapchain.acquired,(unsigned long long)state.swapchain.starved,(unsigned long long)state.swapchain.resized,(unsigned long long)state.swapchain.damaged_pixels);
+    timing_report(stdout);
+    if (state.presentation.wp_presentation != NULL){
+        const struct presentation* presentation = &state.presentation;
+        printf("Presentation: %llu frames presented (%llu with vsync, %llu zero-copy), %llu discarded, %llu late, %llu without feedback, latency %.2f ms on average and %.2f ms at most, refresh %.2f ms\n",
+               (unsigned long long)presentation->presented,(unsigned long long)presentation->vsync,(unsigned long long)presentation->zero_copy,
+               (unsigned long long)presentation->discarded,(unsigned long long)presentation->late,(unsigned long long)presentation->dropped,
+               presentation->presented > 0 ? presentation->latency_sum/1e6/presentation->presented : 0.0,presentation->latency_max/1e6,presentation->refresh/1e6);
+    }
+    if (state.layered){
+        printf("Layers: %llu tree buffers attached\n",(unsigned long long)state.tree_attaches);
+    }
+    if (state.pointer_frames > 0){
+        printf("Pointer: %llu events handled in %llu frames\n",(unsigned long long)state.pointer_events,(unsigned long long)state.pointer_frames);
+    }
+    printf("Commits: %llu, idle for %.1f s with %llu commits (%.2f per second) and %llu wake ups, %llu throttled frames\n",(unsigned long long)state.commits,state.idle_ms/1e3,
+           (unsigned long long)state.idle_commits,state.idle_ms > 0 ? state.idle_commits*1e3/state.idle_ms : 0.0,(unsigned long long)state.wake_ups,(unsigned long long)state.throttled_frames);
+    swapchain_finish(&state.swapchain);
+    tree_worker_stop(&state.worker);
+    trace_stop();
+    if (state.layered){
+        wp_viewport_destroy(state.tree_viewport);
+        wl_subsurface_destroy(state.tree_subsurface);
+        wl_surface_destroy(state.tree_surface);
+    }
+    if (state.wl_subcompositor != NULL){
+        wl_subcompositor_destroy(state.wl_subcompositor);
+    }
+    if (state.backgroundBuffer != NULL){
+        wl_buffer_destroy(state.backgroundBuffer);
+    }
+    if (state.wp_fractional_scale_v1 != NULL){
+        wp_fractional_scale_v1_destroy(state.wp_fractional_scale_v1);
+    }
+    if (state.wp_fractional_scale_manager_v1 != NULL){
+        wp_fractional_scale_manager_v1_destroy(state.wp_fractional_scale_manager_v1);
+    }
+    if (state.wp_viewport != NULL){
+        wp_viewport_destroy(state.wp_viewport);
+    }
+    if (state.wp_viewporter != NULL){
+        wp_viewporter_destroy(state.wp_viewporter);
+    }
+    if (state.wp_single_pixel_buffer_manager_v1 != NULL){
+        wp_single_pixel_buffer_manager_v1_destroy(state.wp_single_pixel_buffer_manager_v1);
+    }
+    // nothing may be left on the render queue when it's destroyed, presentation_finish destroys the
+    // feedback that's still pending
+    if (state.frame_callback != NULL){
+        wl_callback_destroy(state.frame_callback);
+    }
+    xdg_toplevel_destroy(state.xdg_toplevel);
+    xdg_surface_destroy(state.xdg_surface);
+    wl_surface_destroy(state.wl_surface);
+    for (int i = 0; i < state.output_count; ++i) {
+        destroy_output(&state.outputs[i]);
     }
+    wl_proxy_wrapper_destroy(state.render_registry);
+    presentation_finish(&state.presentation);
+    shm_pool_destroy(state.pool);
+    wl_event_queue_destroy(state.render_queue);
     wl_display_disconnect(state.display);
     return 0;
 }
@@ -0,0 +1,448 @@
+#include <stdlib.h>
+#include <string.h>
+#include "render.h"
+
+enum clip_code{
+    CLIP_INSIDE = 0,
+    CLIP_LEFT = 1,
+    CLIP_RIGHT = 2,
+    CLIP_TOP = 4,
+    CLIP_BOTTOM = 8
+};
+
+static int clip_code(int x, int y, const struct clip_rect* clip){
+    int code = CLIP_INSIDE;
+    if (x < clip->left){
+        code |= CLIP_LEFT;
+    }else if (x >= clip->right){
+        code |= CLIP_RIGHT;
+    }
+    if (y < clip->top){
+        code |= CLIP_TOP;
+    }else if (y >= clip->bottom){
+        code |= CLIP_BOTTOM;
+    }
+    return code;
+}
+
+// Cohen-Sutherland, moves the endpoints onto the edges of the clip rectangle
+bool clip_segment(int* x0, int* y0, int* x1, int* y1, const struct clip_rect* clip){
+    int code0 = clip_code(*x0,*y0,clip);
+    int code1 = clip_code(*x1,*y1,clip);
+    while (true){
+        if (!(code0 | code1)){
+            return true;
+        }
+        if (code0 & code1){
+            // both ends are on the same outer side, none of the segment is visible
+            return false;
+        }
+        int code = code0 ? code0 : code1;
+        int64_t dx = *x1-*x0;
+        int64_t dy = *y1-*y0;
+        int x, y;
+        if (code & CLIP_TOP){
+            x = *x0+dx*(clip->top-*y0)/dy;
+            y = clip->top;
+        }else if (code & CLIP_BOTTOM){
+            x = *x0+dx*(clip->bottom-1-*y0)/dy;
+            y = clip->bottom-1;
+        }else if (code & CLIP_LEFT){
+            y = *y0+dy*(clip->left-*x0)/dx;
+            x = clip->left;
+        }else{
+            y = *y0+dy*(clip->right-1-*x0)/dx;
+            x = clip->right-1;
+        }
+        if (code == code0){
+            *x0 = x;
+            *y0 = y;
+            code0 = clip_code(x,y,clip);
+        }else{
+            *x1 = x;
+            *y1 = y;
+            code1 = clip_code(x,y,clip);
+        }
+    }
+}
+
+// the segment is clipped once up front, so plotting it never has to check a pixel
+void draw_segment_clipped(uint32_t* data, uint16_t width, const struct clip_rect* clip, int x0, int y0, int x1, int y1, uint32_t color){
+    if (!clip_segment(&x0,&y0,&x1,&y1,clip)){
+        return;
+    }
+    int dx = abs(x1-x0);
+    int dy = abs(y1-y0);
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? width : -width;
+    uint32_t* pixel = data+(size_t)y0*width+x0;
+    if (dx == 0 || dx == dy){
+        // vertical and diagonal segments are the only ones the trees use, they step by a constant
+        const int step = (dx == 0 ? 0 : sx)+(dy == 0 ? 0 : sy);
+        for (int i = 0; i <= dy; ++i) {
+            *pixel = color;
+            pixel += step;
+        }
+        return;
+    }
+    int error = (dx > dy ? dx : -dy)/2;
+    for (int i = 0; i <= (dx > dy ? dx : dy); ++i) {
+        *pixel = color;
+        int e = error;
+        if (e > -dx){
+            error -= dy;
+            pixel += sx;
+        }
+        if (e < dy){
+            error += dx;
+            pixel += sy;
+        }
+    }
+}
+
+static bool skeleton_scaled(const struct tree_skeleton* skeleton, uint16_t width, uint16_t height){
+    return (skeleton->width != width || skeleton->height != height) && skeleton->width > 0 && skeleton->height > 0;
+}
+
+// coordinates of the i-th segment in a width*height buffer, a skeleton generated for another size
+// is stretched to the new one
+static void segment_at(const struct tree_skeleton* skeleton, uint32_t i, uint16_t width, uint16_t height, int* x0, int* y0, int* x1, int* y1){
+    *x0 = skeleton->x0[i];
+    *y0 = skeleton->y0[i];
+    *x1 = skeleton->x1[i];
+    *y1 = skeleton->y1[i];
+    if (skeleton_scaled(skeleton,width,height)){
+        *x0 = *x0*width/skeleton->width;
+        *y0 = *y0*height/skeleton->height;
+        *x1 = *x1*width/skeleton->width;
+        *y1 = *y1*height/skeleton->height;
+    }
+}
+
+// half of a foliage arc from column x to column end, the row of every column comes from the arc table.
+// The columns are clipped once and the rows only have to be checked if the arc reaches out of the clip
+// rectangle vertically.
+static void draw_arc_clipped(uint32_t* data, uint16_t width, const struct clip_rect* clip, int x, int y, int end, uint32_t color){
+    const int direction = end < x ? -1 : 1;
+    const int length = abs(end-x)+1;
+    const int8_t* heights = tree_arc_heights(length);
+    if (heights == NULL){
+        return;
+    }
+    int first = direction > 0 ? clip->left-x : x-(clip->right-1);
+    int last = direction > 0 ? clip->right-1-x : x-clip->left;
+    first = first > 0 ? first : 0;
+    last = last < length-1 ? last : length-1;
+    if (y-ARC_HEIGHT >= clip->top && y+ARC_HEIGHT < clip->bottom){
+        const ptrdiff_t origin = (ptrdiff_t)y*width+x;
+        for (int i = first; i <= last; ++i) {
+            data[origin+direction*i-(ptrdiff_t)heights[i]*width] = color;
+        }
+        return;
+    }
+    for (int i = first; i <= last; ++i) {
+        const int row = y-heights[i];
+        if (row >= clip->top && row < clip->bottom){
+            data[(size_t)row*width+x+direction*i] = color;
+        }
+    }
+}
+
+// a stretched arc has gaps between its columns, so it's drawn as lines between the scaled points
+static void draw_arc_scaled(const struct tree_skeleton* skeleton, uint32_t* data, uint16_t width, uint16_t height, const struct clip_rect* clip, uint32_t i, uint32_t color){
+    const int x = skeleton->x0[i];
+    const int y = skeleton->y0[i];
+    const int direction = skeleton->x1[i] < x ? -1 : 1;
+    const int length = abs(skeleton->x1[i]-x)+1;
+    const int8_t* heights = tree_arc_heights(length);
+    if (heights == NULL){
+        return;
+    }
+    int previous_x = x*width/skeleton->width;
+    int previous_y = (y-heights[0])*height/skeleton->height;
+    for (int j = 1; j < length; ++j) {
+        const int next_x = (x+direction*j)*width/skeleton->width;
+        const int next_y = (y-heights[j])*height/skeleton->height;
+        draw_segment_clipped(data,width,clip,previous_x,previous_y,next_x,next_y,color);
+        previous_x = next_x;
+        previous_y = next_y;
+    }
+    if (length == 1){
+        draw_segment_clipped(data,width,clip,previous_x,previous_y,previous_x,previous_y,color);
+    }
+}
+
+struct clip_rect skeleton_bounds(const struct tree_skeleton* skeleton, uint16_t width, uint16_t height){
+    struct clip_rect bounds = {width, height, 0, 0};
+    for (uint32_t i = 0; i < skeleton->count; ++i) {
+        int x0, y0, x1, y1;
+        segment_at(skeleton,i,width,height,&x0,&y0,&x1,&y1);
+        if (skeleton->shape[i] == TREE_SHAPE_ARC){
+            // the highest and lowest row the arc reaches
+            const int length = abs(skeleton->x1[i]-skeleton->x0[i])+1;
+            const int8_t* heights = tree_arc_heights(length);
+            int above = 0, below = 0;
+            for (int j = 0; heights != NULL && j < length; ++j) {
+                above = heights[j] > above ? heights[j] : above;
+                below = heights[j] < below ? heights[j] : below;
+            }
+            y0 = skeleton->y0[i]-above;
+            y1 = skeleton->y0[i]-below;
+            if (skeleton_scaled(skeleton,width,height)){
+                y0 = y0*height/skeleton->height;
+                y1 = y1*height/skeleton->height;
+            }
+        }
+        // the copies of a thick segment reach (thickness-1)/2 pixels to the left and thickness/2 to the right
+        const int thickness = skeleton->thickness[i] > 0 ? skeleton->thickness[i] : 1;
+        const int left = (x0 < x1 ? x0 : x1)-(thickness-1)/2;
+        const int right = (x0 > x1 ? x0 : x1)+thickness/2+1;
+        const int top = y0 < y1 ? y0 : y1;
+        const int bottom = (y0 > y1 ? y0 : y1)+1;
+        bounds.left = left < bounds.left ? left : bounds.left;
+        bounds.top = top < bounds.top ? top : bounds.top;
+        bounds.right = right > bounds.right ? right : bounds.right;
+        bounds.bottom = bottom > bounds.bottom ? bottom : bounds.bottom;
+    }
+    bounds.left = bounds.left > 0 ? bounds.left : 0;
+    bounds.top = bounds.top > 0 ? bounds.top : 0;
+    bounds.right = bounds.right < width ? bounds.right : width;
+    bounds.bottom = bounds.bottom < height ? bounds.bottom : height;
+    if (bounds.left >= bounds.right || bounds.top >= bounds.bottom){
+        return (struct clip_rect){0};
+    }
+    return bounds;
+}
+
+void rasterize_skeleton(const struct tree_skeleton* skeleton, uint32_t* data, uint16_t width, uint16_t height, const struct clip_rect* region){
+    struct clip_rect clip = {0, 0, width, height};
+    if (region != NULL){
+        clip.left = region->left > 0 ? region->left : 0;
+        clip.top = region->top > 0 ? region->top : 0;
+        clip.right = region->right < width ? region->right : width;
+        clip.bottom = region->bottom < height ? region->bottom : height;
+        if (clip.left >= clip.right || clip.top >= clip.bottom){
+            return;
+        }
+    }
+    for (uint32_t i = 0; i < skeleton->count; ++i) {
+        int x0, y0, x1, y1;
+        segment_at(skeleton,i,width,height,&x0,&y0,&x1,&y1);
+        const uint32_t color = tree_palette[skeleton->color[i]];
+        if (skeleton->shape[i] == TREE_SHAPE_ARC){
+            if (skeleton_scaled(skeleton,width,height)){
+                draw_arc_scaled(skeleton,data,width,height,&clip,i,color);
+            }else{
+                draw_arc_clipped(data,width,&clip,x0,y0,x1,color);
+            }
+            continue;
+        }
+        // thicker segments are drawn as neighbouring copies next to each other
+        for (int t = 0; t < skeleton->thickness[i]; ++t) {
+            int offset = t%2 ? (t+1)/2 : -(t/2);
+            draw_segment_clipped(data,width,&clip,x0+offset,y0,x1+offset,y1,color);
+        }
+    }
+}
+
+// the original one step renderers, they generate into a scratch skeleton and rasterize it right away
+static _Thread_local struct tree_skeleton scratch_skeleton;
+
+void draw_tree_new(uint32_t* data, int position, uint16_t width, uint16_t height, uint16_t tree_size, uint16_t branch_width){
+    if (width == 0){
+        return;
+    }
+    tree_skeleton_clear(&scratch_skeleton,width,height);
+    generate_tree_new(&scratch_skeleton,position%width,position/width,tree_size,branch_width);
+    rasterize_skeleton(&scratch_skeleton,data,width,height,NULL);
+}
+
+void draw_branches(uint32_t* data,int position, uint16_t* width, uint16_t* height, uint16_t* branch_size){
+    if (*width == 0){
+        return;
+    }
+    tree_skeleton_clear(&scratch_skeleton,*width,*height);
+    generate_branches(&scratch_skeleton,position%*width,position/ *width,*branch_size);
+    rasterize_skeleton(&scratch_skeleton,data,*width,*height,NULL);
+}
+
+void draw_tree(uint32_t* data, uint16_t width, uint16_t height, uint16_t branch_size){
+    tree_skeleton_clear(&scratch_skeleton,width,height);
+    generate_tree(&scratch_skeleton,branch_size);
+    rasterize_skeleton(&scratch_skeleton,data,width,height,NULL);
+}
+
+bool render_skeleton(struct render_target* target, uint16_t width, uint16_t height, const struct tree_skeleton* skeleton){
+    if (!target->interface->resize(target,width,height)){
+        return false;
+    }
+    // the target still holds the previous tree
+    memset(target->data,0,(size_t)width*height*4);
+    rasterize_skeleton(skeleton,target->data,width,height,NULL);
+    if (target->interface->submit){
+        target->interface->submit(target);
+    }
+    return true;
+}
+
+bool render_tree(struct render_target* target, uint16_t width, uint16_t height, const struct tree_params* params){
+    // the skeleton is only needed until it's rasterized
+    if (!generate_skeleton(&scratch_skeleton,width,height,params)){
+        return false;
+    }
+    return render_skeleton(target,width,height,&scratch_skeleton);
+}
+
+bool render_target_prepare(struct render_target* target, uint16_t width, uint16_t height){
+    if (target->interface->prepare == NULL){
+        return true;
+    }
+    return target->interface->prepare(target,width,height);
+}
+
+void render_target_destroy(struct render_target* target){
+    if (target != NULL){
+        target->interface->destroy(target);
+    }
+}
+
+bool write_image(FILE* file, const uint32_t* data, uint16_t width, uint16_t height, enum image_format format){
+    const int depth = format == IMAGE_FORMAT_PAM ? 4 : 3;
+    if (format == IMAGE_FORMAT_PAM){
+        fprintf(file,"P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",width,height);
+    }else{
+        fprintf(file,"P6\n%d %d\n255\n",width,height);
+    }
+    uint8_t* row = malloc((size_t)width*depth);
+    if (row == NULL){
+        return false;
+    }
+    bool ok = true;
+    for (int y = 0; y < height && ok; ++y) {
+        // pixels are stored as 0xAARRGGBB
+        for (int x = 0; x < width; ++x) {
+            uint32_t pixel = data[(size_t)y*width+x];
+            row[x*depth] = pixel>>16;
+            row[x*depth+1] = pixel>>8;
+            row[x*depth+2] = pixel;
+            if (depth == 4){
+                row[x*depth+3] = pixel>>24;
+            }
+        }
+        ok = fwrite(row,depth,width,file) == width;
+    }
+    free(row);
+    return ok;
+}
+
+static bool memory_target_resize(struct render_target* target, uint16_t width, uint16_t height){
+    struct memory_target* memory = (struct memory_target*)target;
+    const size_t pixels = (size_t)width*height;
+    if (memory->capacity < pixels){
+        uint32_t* data = realloc(target->data,pixels*4);
+        if (data == NULL){
+            return false;
+        }
+        target->data = data;
+        memory->capacity = pixels;
+    }
+    target->width = width;
+    target->height = height;
+    return true;
+}
+
+// the pattern needs exactly one %d, %i or %u (optionally with a 0 flag and a width like %04d), %% is a literal %.
+// It's never passed to printf itself.
+static bool path_pattern_valid(const char* pattern){
+    int conversions = 0;
+    for (const char* c = pattern; *c != '\0'; ++c) {
+        if (*c != '%'){
+            continue;
+        }
+        ++c;
+        if (*c == '%'){
+            continue;
+        }
+        int digits = 0;
+        while (*c >= '0' && *c <= '9'){
+            ++c;
+            ++digits;
+        }
+        if (digits > 2 || (*c != 'd' && *c != 'i' && *c != 'u')){
+            return false;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+// replaces the conversion of a valid pattern with the number, the path is cut off at size
+static void format_path(char* path, size_t size, const char* pattern, int number){
+    size_t length = 0;
+    for (const char* c = pattern; *c != '\0' && length+1 < size; ++c) {
+        if (*c != '%'){
+            path[length++] = *c;
+            continue;
+        }
+        ++c;
+        if (*c == '%'){
+            path[length++] = '%';
+            continue;
+        }
+        const bool zeros = *c == '0';
+        int width = 0;
+        while (*c >= '0' && *c <= '9'){
+            width = width*10+(*c++-'0');
+        }
+        const int written = snprintf(path+length,size-length,zeros ? "%0*d" : "%*d",width,number);
+        if (written > 0){
+            length += (size_t)written < size-length ? (size_t)written : size-length-1;
+        }
+    }
+    path[length] = '\0';
+}
+
+static void memory_target_submit(struct render_target* target){
+    struct memory_target* memory = (struct memory_target*)target;
+    memory->submitted++;
+    if (memory->path == NULL){
+        return;
+    }
+    char path[4096];
+    format_path(path,sizeof(path),memory->path,memory->submitted);
+    FILE* file = fopen(path,"wb");
+    if (file == NULL){
+        fprintf(stderr,"Error opening %s.\n",path);
+        return;
+    }
+    if (!write_image(file,target->data,target->width,target->height,memory->format)){
+        fprintf(stderr,"Error writing %s.\n",path);
+    }
+    fclose(file);
+}
+
+static void memory_target_destroy(struct render_target* target){
+    free(target->data);
+    free(target);
+}
+
+static const struct render_target_interface memory_target_interface = {
+        .resize = memory_target_resize,
+        .submit = memory_target_submit,
+        .destroy = memory_target_destroy
+};
+
+struct memory_target* memory_target_create(const char* path, enum image_format format){
+    if (path != NULL && !path_pattern_valid(path)){
+        fprintf(stderr,"Error: %s needs exactly one %%d for the tree number (%%%% for a literal %%).\n",path);
+        return NULL;
+    }
+    struct memory_target* memory = calloc(1, sizeof(*memory));
+    if (memory == NULL){
+        return NULL;
+    }
+    memory->base.interface = &memory_target_interface;
+    memory->path = path;
+    memory->format = format;
+    return memory;
+}
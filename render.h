@@ -0,0 +1,78 @@
+#ifndef REGROW_RENDER_H
+#define REGROW_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tree.h"
+
+// pixels inside [left, right) x [top, bottom) may be drawn
+struct clip_rect{
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+struct render_target;
+
+// what a backend has to implement so the tree renderers can draw into it
+struct render_target_interface{
+    // makes data point to at least width*height pixels with a stride of width
+    bool (*resize)(struct render_target* target, uint16_t width, uint16_t height);
+    // optional, gets the memory for the size on the thread that owns the target, so that resize can run
+    // on another one. Targets without it can allocate in resize.
+    bool (*prepare)(struct render_target* target, uint16_t width, uint16_t height);
+    // the tree in data is finished and can be shown/stored
+    void (*submit)(struct render_target* target);
+    void (*destroy)(struct render_target* target);
+};
+
+struct render_target{
+    const struct render_target_interface* interface;
+    uint32_t* data;
+    uint16_t width;
+    uint16_t height;
+};
+
+enum image_format{
+    IMAGE_FORMAT_PPM,
+    IMAGE_FORMAT_PAM
+};
+
+// renders into plain memory and optionally writes every submitted tree to a file
+struct memory_target{
+    struct render_target base;
+    size_t capacity;
+    // file name with one %d (like %04d) for the tree number and %% for a literal %, NULL to keep the trees in memory only
+    const char* path;
+    enum image_format format;
+    int submitted;
+};
+
+// clips the segment against the rectangle, returns false if none of it is inside
+bool clip_segment(int* x0, int* y0, int* x1, int* y1, const struct clip_rect* clip);
+void draw_segment_clipped(uint32_t* data, uint16_t width, const struct clip_rect* clip, int x0, int y0, int x1, int y1, uint32_t color);
+// pixels the skeleton can cover in a width*height buffer, clipped to it
+struct clip_rect skeleton_bounds(const struct tree_skeleton* skeleton, uint16_t width, uint16_t height);
+// draws the skeleton into a width*height buffer, only inside region if it's not NULL
+void rasterize_skeleton(const struct tree_skeleton* skeleton, uint32_t* data, uint16_t width, uint16_t height, const struct clip_rect* region);
+
+// generate and rasterize in one step
+void draw_tree_new(uint32_t* data, int position, uint16_t width, uint16_t height, uint16_t tree_size, uint16_t branch_width);
+void draw_branches(uint32_t* data,int position, uint16_t* width, uint16_t* height, uint16_t* branch_size);
+void draw_tree(uint32_t* data, uint16_t width, uint16_t height, uint16_t branch_size);
+
+// clears the target and rasterizes the skeleton into it, returns false if the target couldn't be resized
+bool render_skeleton(struct render_target* target, uint16_t width, uint16_t height, const struct tree_skeleton* skeleton);
+// generates the tree and renders it
+bool render_tree(struct render_target* target, uint16_t width, uint16_t height, const struct tree_params* params);
+// see render_target_interface.prepare, true for targets that don't need it
+bool render_target_prepare(struct render_target* target, uint16_t width, uint16_t height);
+void render_target_destroy(struct render_target* target);
+
+// returns NULL if the path isn't a valid pattern
+struct memory_target* memory_target_create(const char* path, enum image_format format);
+bool write_image(FILE* file, const uint32_t* data, uint16_t width, uint16_t height, enum image_format format);
+
+#endif
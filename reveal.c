@@ -0,0 +1,88 @@
+#include <string.h>
+#include "reveal.h"
+
+void reveal_init(struct reveal* reveal, uint32_t duration, uint32_t hold, enum reveal_easing easing){
+    reveal->duration = duration > 0 ? duration : 1;
+    reveal->hold = hold;
+    reveal->easing = easing;
+    reveal_restart(reveal);
+}
+
+void reveal_restart(struct reveal* reveal){
+    reveal->phase = REVEAL_GROWING;
+    reveal->started = false;
+}
+
+// maps the linear progress t in [0, 1] onto the curve
+static double ease(enum reveal_easing easing, double t){
+    switch (easing){
+        case REVEAL_EASING_SMOOTH:
+            return t*t*(3-2*t);
+        case REVEAL_EASING_CUBIC:
+            return 1-(1-t)*(1-t)*(1-t);
+        default:
+            return t;
+    }
+}
+
+static uint32_t phase_duration(const struct reveal* reveal){
+    return reveal->phase == REVEAL_HOLDING ? reveal->hold : reveal->duration;
+}
+
+uint16_t reveal_update(struct reveal* reveal, uint32_t time, uint16_t height){
+    if (reveal->phase == REVEAL_DONE){
+        return height;
+    }
+    if (!reveal->started){
+        reveal->started = true;
+        reveal->start = time;
+    }
+    // unsigned difference, so the wrap around of the timestamps doesn't matter
+    uint32_t elapsed = time-reveal->start;
+    while (reveal->phase != REVEAL_DONE && elapsed >= phase_duration(reveal)){
+        // the next phase starts where this one should have ended, not at this frame
+        elapsed -= phase_duration(reveal);
+        reveal->start += phase_duration(reveal);
+        reveal->phase++;
+    }
+    if (reveal->phase == REVEAL_DONE){
+        return height;
+    }
+    if (reveal->phase == REVEAL_HOLDING){
+        return 0;
+    }
+    const double progress = ease(reveal->easing,(double)elapsed/reveal->duration);
+    const uint16_t rows = (uint16_t)(progress*height+0.5);
+    return reveal->phase == REVEAL_GROWING ? height-rows : rows;
+}
+
+int32_t reveal_time_left(const struct reveal* reveal, uint32_t time){
+    if (reveal->phase == REVEAL_DONE){
+        return -1;
+    }
+    if (reveal->phase != REVEAL_HOLDING || !reveal->started){
+        return 0;
+    }
+    uint32_t elapsed = time-reveal->start;
+    return elapsed >= reveal->hold ? 0 : (int32_t)(reveal->hold-elapsed);
+}
+
+void reveal_skip(struct reveal* reveal){
+    if (reveal->phase == REVEAL_HOLDING){
+        reveal->phase = REVEAL_SHRINKING;
+        reveal->started = false;
+    }
+}
+
+bool reveal_parse_easing(const char* name, enum reveal_easing* easing){
+    if (strcmp(name,"linear") == 0){
+        *easing = REVEAL_EASING_LINEAR;
+    }else if (strcmp(name,"smooth") == 0){
+        *easing = REVEAL_EASING_SMOOTH;
+    }else if (strcmp(name,"cubic") == 0){
+        *easing = REVEAL_EASING_CUBIC;
+    }else{
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef REGROW_REVEAL_H
+#define REGROW_REVEAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// how long the tree takes to grow in (and the same again to disappear) by default
+#define REVEAL_DURATION_DEFAULT 1600
+// how long the grown tree stays on screen before it disappears
+#define REVEAL_HOLD_DEFAULT 2000
+
+enum reveal_easing{
+    REVEAL_EASING_LINEAR,
+    // slow start and end
+    REVEAL_EASING_SMOOTH,
+    // fast start, slow end
+    REVEAL_EASING_CUBIC
+};
+
+enum reveal_phase{
+    // the tree is uncovered from the bottom up
+    REVEAL_GROWING,
+    // fully visible, nothing changes until the hold time is over
+    REVEAL_HOLDING,
+    // and covered again from the top down
+    REVEAL_SHRINKING,
+    // fully covered, waiting for the next tree
+    REVEAL_DONE
+};
+
+// position of the reveal line as a function of time instead of the number of frames,
+// so it runs at the same speed at any refresh rate and catches up after throttled frames
+struct reveal{
+    uint32_t duration;
+    uint32_t hold;
+    enum reveal_easing easing;
+    enum reveal_phase phase;
+    // the phase starts at the first timestamp it's updated with
+    bool started;
+    uint32_t start;
+};
+
+void reveal_init(struct reveal* reveal, uint32_t duration, uint32_t hold, enum reveal_easing easing);
+// grows a new tree, starting with the next update
+void reveal_restart(struct reveal* reveal);
+// advances to the given time (in ms, it may wrap around) and returns the first visible row
+uint16_t reveal_update(struct reveal* reveal, uint32_t time, uint16_t height);
+// ms from the given time until the picture changes again, 0 while it's moving and -1 once it's done
+int32_t reveal_time_left(const struct reveal* reveal, uint32_t time);
+// ends the hold early, the tree starts disappearing with the next update
+void reveal_skip(struct reveal* reveal);
+// parses linear, smooth or cubic, returns false for anything else
+bool reveal_parse_easing(const char* name, enum reveal_easing* easing);
+
+#endif
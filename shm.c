@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "shm.h"
+
+static void randname(char *buf){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME,&ts);
+    long r = ts.tv_nsec;
+    for (int i = 0; i < 6; ++i) {
+        buf[i] = 'A' + (r&15) + (r&16)*2;
+        r >>= 2;
+    }
+}
+
+static int create_shm_file(){
+#ifdef MFD_CLOEXEC
+    // memfd doesn't need a name in /dev/shm, fall back to shm_open on kernels without it
+    int memfd = memfd_create("regrow-shm", MFD_CLOEXEC);
+    if (memfd >= 0){
+        return memfd;
+    }
+#endif
+    int retries = 100;
+    do{
+        char name[] = "/wl_shm-XXXXXX";
+        randname(name+ sizeof(name)-7);
+        retries--;
+        int fd = shm_open(name,O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0){
+            if(shm_unlink(name) == 0) {
+                return fd;
+            }
+        }
+    } while (retries > 0 && errno == EEXIST);
+    return -1;
+}
+
+int allocate_shm_file(size_t size){
+    int fd = create_shm_file();
+    if (fd<0){
+        return -1;
+    }
+    int ret;
+    do {
+        ret = ftruncate(fd,size);
+    } while (ret<0 && errno == EINTR);
+    if (ret<0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// poziva se kada compositor vise ne koristi buffer
+static void wl_buffer_release(void *data, struct wl_buffer *wl_buffer){
+    struct shm_buffer* buffer = data;
+    buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+        .release = wl_buffer_release
+};
+
+// address space that's reserved for a pool, enough for a handful of 8K buffers
+#define SHM_POOL_RESERVE (sizeof(void*) >= 8 ? (size_t)2<<30 : (size_t)256<<20)
+
+static size_t page_align(size_t size){
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size+page-1)/page*page;
+}
+
+struct shm_pool* shm_pool_create(struct wl_shm* shm, size_t size){
+    struct shm_pool* pool = calloc(1, sizeof(*pool));
+    if (pool == NULL){
+        return NULL;
+    }
+    size = page_align(size);
+    pool->reserved = SHM_POOL_RESERVE;
+    if (pool->reserved < size){
+        pool->reserved = size;
+    }
+    pool->fd = allocate_shm_file(size);
+    if (pool->fd < 0){
+        free(pool);
+        return NULL;
+    }
+    // only reserve the range, nothing is backed by memory until the file gets mapped into it
+    pool->data = mmap(NULL,pool->reserved,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+    if (pool->data == MAP_FAILED){
+        close(pool->fd);
+        free(pool);
+        return NULL;
+    }
+    if (mmap(pool->data,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,pool->fd,0) == MAP_FAILED){
+        munmap(pool->data,pool->reserved);
+        close(pool->fd);
+        free(pool);
+        return NULL;
+    }
+    pool->shm = shm;
+    pool->size = size;
+    pool->wl_shm_pool = wl_shm_create_pool(shm,pool->fd,size);
+    return pool;
+}
+
+void shm_pool_destroy(struct shm_pool* pool){
+    struct shm_buffer* slot = pool->slots;
+    while (slot != NULL){
+        struct shm_buffer* next = slot->next;
+        if (slot->wl_buffer != NULL){
+            wl_buffer_destroy(slot->wl_buffer);
+        }
+        free(slot);
+        slot = next;
+    }
+    wl_shm_pool_destroy(pool->wl_shm_pool);
+    munmap(pool->data,pool->reserved);
+    close(pool->fd);
+    free(pool);
+}
+
+// grows the file, the compositor side mapping and our own mapping to at least the given size
+static bool shm_pool_grow(struct shm_pool* pool, size_t size){
+    if (size <= pool->size){
+        return true;
+    }
+    // double the pool so that a window that keeps growing doesn't resize on every configure
+    size_t new_size = pool->size*2;
+    if (new_size < size){
+        new_size = size;
+    }
+    new_size = page_align(new_size);
+    if (new_size > pool->reserved){
+        new_size = size;
+    }
+    if (new_size > pool->reserved){
+        return false;
+    }
+    int ret;
+    do {
+        ret = ftruncate(pool->fd,new_size);
+    } while (ret<0 && errno == EINTR);
+    if (ret<0){
+        return false;
+    }
+    // map the new part of the file right after the old one, existing buffers keep their address
+    if (mmap(pool->data+pool->size,new_size-pool->size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_FIXED,pool->fd,pool->size) == MAP_FAILED){
+        return false;
+    }
+    wl_shm_pool_resize(pool->wl_shm_pool,new_size);
+    pool->size = new_size;
+    return true;
+}
+
+static bool slot_is_free(struct shm_buffer* slot){
+    return !slot->owned && !slot->busy;
+}
+
+// joins neighbouring free slots so that their memory can hold a bigger buffer
+static void shm_pool_merge_free(struct shm_pool* pool){
+    struct shm_buffer* slot = pool->slots;
+    while (slot != NULL && slot->next != NULL){
+        struct shm_buffer* next = slot->next;
+        if (slot_is_free(slot) && slot_is_free(next)){
+            if (slot->wl_buffer != NULL){
+                wl_buffer_destroy(slot->wl_buffer);
+                slot->wl_buffer = NULL;
+            }
+            if (next->wl_buffer != NULL){
+                wl_buffer_destroy(next->wl_buffer);
+            }
+            slot->size = next->offset + next->size - slot->offset;
+            slot->next = next->next;
+            free(next);
+        }else{
+            slot = next;
+        }
+    }
+}
+
+// finds the smallest free slot that can hold size bytes, exact matches win since they keep their wl_buffer
+static struct shm_buffer* shm_pool_find_slot(struct shm_pool* pool, uint16_t width, uint16_t height, size_t size){
+    struct shm_buffer* best = NULL;
+    for (struct shm_buffer* slot = pool->slots; slot != NULL; slot = slot->next){
+        if (!slot_is_free(slot) || slot->size < size){
+            continue;
+        }
+        if (slot->wl_buffer != NULL && slot->width == width && slot->height == height){
+            return slot;
+        }
+        if (best == NULL || slot->size < best->size){
+            best = slot;
+        }
+    }
+    return best;
+}
+
+struct shm_buffer* shm_pool_get_buffer(struct shm_pool* pool, uint16_t width, uint16_t height){
+    // each pixel contains 4 bytes
+    const int stride = width*4;
+    const size_t size = (size_t)stride*height;
+
+    struct shm_buffer* slot = shm_pool_find_slot(pool,width,height,size);
+    if (slot == NULL){
+        shm_pool_merge_free(pool);
+        slot = shm_pool_find_slot(pool,width,height,size);
+    }
+    if (slot == NULL){
+        struct shm_buffer* last = pool->slots;
+        while (last != NULL && last->next != NULL){
+            last = last->next;
+        }
+        if (last != NULL && slot_is_free(last)){
+            // the last slot is too small but nothing comes after it, so it can simply be extended
+            if (!shm_pool_grow(pool,last->offset+size)){
+                return NULL;
+            }
+            if (last->wl_buffer != NULL){
+                wl_buffer_destroy(last->wl_buffer);
+                last->wl_buffer = NULL;
+            }
+            last->size = size;
+            pool->used = last->offset+size;
+            slot = last;
+        }else{
+            if (!shm_pool_grow(pool,pool->used+size)){
+                return NULL;
+            }
+            slot = calloc(1, sizeof(*slot));
+            if (slot == NULL){
+                return NULL;
+            }
+            slot->pool = pool;
+            slot->offset = pool->used;
+            slot->size = size;
+            pool->used += size;
+            if (last == NULL){
+                pool->slots = slot;
+            }else{
+                last->next = slot;
+            }
+        }
+    }
+
+    if (slot->wl_buffer != NULL && (slot->width != width || slot->height != height)){
+        wl_buffer_destroy(slot->wl_buffer);
+        slot->wl_buffer = NULL;
+    }
+    if (slot->wl_buffer == NULL){
+        // iz pool-a mozemo alocirati buffere zadane velicine koji pocinju sa zadanim offsetom u poolu i imaju zadani format
+        slot->wl_buffer = wl_shm_pool_create_buffer(pool->wl_shm_pool,slot->offset,width,height,stride,WL_SHM_FORMAT_XRGB8888);
+        wl_buffer_add_listener(slot->wl_buffer,&buffer_listener,slot);
+        slot->width = width;
+        slot->height = height;
+        slot->stride = stride;
+    }
+    slot->data = (uint32_t*)(pool->data + slot->offset);
+    slot->owned = true;
+    return slot;
+}
+
+bool shm_buffer_reshape(struct shm_buffer* buffer, uint16_t width, uint16_t height){
+    const int stride = width*4;
+    if (buffer->busy || (size_t)stride*height > buffer->size){
+        return false;
+    }
+    if (buffer->width == width && buffer->height == height){
+        return true;
+    }
+    // a wl_buffer has a fixed size, but a new one over the same memory is only a request to the compositor
+    wl_buffer_destroy(buffer->wl_buffer);
+    buffer->wl_buffer = wl_shm_pool_create_buffer(buffer->pool->wl_shm_pool,buffer->offset,width,height,stride,WL_SHM_FORMAT_XRGB8888);
+    wl_buffer_add_listener(buffer->wl_buffer,&buffer_listener,buffer);
+    buffer->width = width;
+    buffer->height = height;
+    buffer->stride = stride;
+    return true;
+}
+
+void shm_pool_put_buffer(struct shm_buffer* buffer){
+    if (buffer != NULL){
+        buffer->owned = false;
+    }
+}
+
+uint32_t* shm_buffer_data(struct shm_buffer* buffer){
+    return buffer->data;
+}
+
+void shm_buffer_attach(struct wl_surface* surface, struct shm_buffer* buffer){
+    if (buffer == NULL){
+        return;
+    }
+    buffer->busy = true;
+    wl_surface_attach(surface,buffer->wl_buffer,0,0);
+}
+
+// the buffer on screen can't be drawn into, it's replaced until the compositor releases it
+static bool shm_target_prepare(struct render_target* target, uint16_t width, uint16_t height){
+    struct shm_target* shm = (struct shm_target*)target;
+    if (shm->buffer == NULL || !shm_buffer_reshape(shm->buffer,width,height)){
+        shm_pool_put_buffer(shm->buffer);
+        shm->buffer = shm_pool_get_buffer(shm->pool,width,height);
+        if (shm->buffer == NULL){
+            target->data = NULL;
+            target->width = 0;
+            target->height = 0;
+            return false;
+        }
+    }
+    target->data = shm_buffer_data(shm->buffer);
+    target->width = width;
+    target->height = height;
+    return true;
+}
+
+static bool shm_target_resize(struct render_target* target, uint16_t width, uint16_t height){
+    return target->data != NULL && target->width == width && target->height == height;
+}
+
+static void shm_target_destroy(struct render_target* target){
+    struct shm_target* shm = (struct shm_target*)target;
+    shm_pool_put_buffer(shm->buffer);
+    free(shm);
+}
+
+static const struct render_target_interface shm_target_interface = {
+        .resize = shm_target_resize,
+        .prepare = shm_target_prepare,
+        .submit = NULL,
+        .destroy = shm_target_destroy
+};
+
+struct shm_target* shm_target_create(struct shm_pool* pool){
+    struct shm_target* shm = calloc(1, sizeof(*shm));
+    if (shm == NULL){
+        return NULL;
+    }
+    shm->base.interface = &shm_target_interface;
+    shm->pool = pool;
+    return shm;
+}
@@ -0,0 +1,69 @@
+#ifndef REGROW_SHM_H
+#define REGROW_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-client.h>
+#include "render.h"
+
+// a single sub-allocation of the pool that is backed by its own wl_buffer
+struct shm_buffer{
+    struct shm_pool* pool;
+    struct wl_buffer* wl_buffer;
+    size_t offset;
+    size_t size;
+    // stays mapped for the whole life of the pool, even when the pool grows
+    uint32_t* data;
+    uint16_t width;
+    uint16_t height;
+    int stride;
+    // the client still holds the buffer (it is not on the free list)
+    bool owned;
+    // the compositor may still read the buffer (attached and not yet released)
+    bool busy;
+    // next slot in the pool, sorted by offset
+    struct shm_buffer* next;
+};
+
+// one long lived shm file per window that grows on demand and hands out buffers
+struct shm_pool{
+    struct wl_shm* shm;
+    struct wl_shm_pool* wl_shm_pool;
+    int fd;
+    // the pool is mapped at the start of a reserved address range so growing it never moves the pixels
+    uint8_t* data;
+    size_t reserved;
+    size_t size;
+    // end of the last slot, everything after it is unused
+    size_t used;
+    struct shm_buffer* slots;
+};
+
+// render target that draws straight into a buffer of the pool. Only prepare takes buffers from the pool,
+// on the thread that owns it. resize just switches to the prepared buffer, so another thread can render.
+struct shm_target{
+    struct render_target base;
+    struct shm_pool* pool;
+    struct shm_buffer* buffer;
+};
+
+int allocate_shm_file(size_t size);
+
+struct shm_pool* shm_pool_create(struct wl_shm* shm, size_t size);
+void shm_pool_destroy(struct shm_pool* pool);
+
+// returns a buffer of the given size, reusing released slots whenever possible
+struct shm_buffer* shm_pool_get_buffer(struct shm_pool* pool, uint16_t width, uint16_t height);
+// gives an owned buffer a new size without moving it, returns false if it's still busy or too small
+bool shm_buffer_reshape(struct shm_buffer* buffer, uint16_t width, uint16_t height);
+// the client is done with the buffer, it goes back to the free list once the compositor releases it
+void shm_pool_put_buffer(struct shm_buffer* buffer);
+
+// pixels of the buffer, valid until the buffer is put back
+uint32_t* shm_buffer_data(struct shm_buffer* buffer);
+void shm_buffer_attach(struct wl_surface* surface, struct shm_buffer* buffer);
+
+struct shm_target* shm_target_create(struct shm_pool* pool);
+
+#endif
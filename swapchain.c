@@ -0,0 +1,169 @@
+#include <string.h>
+#include "swapchain.h"
+
+static void full_damage(struct swapchain* swapchain, struct damage* damage){
+    damage_full(damage,swapchain->width,swapchain->height);
+}
+
+// damage of all frames after the given one, up to and including the current frame
+static void damage_since(struct swapchain* swapchain, uint64_t frame, struct damage* damage){
+    if (frame == 0 || swapchain->frame-frame > SWAPCHAIN_HISTORY){
+        full_damage(swapchain,damage);
+        return;
+    }
+    damage_clear(damage);
+    for (uint64_t i = frame+1; i <= swapchain->frame; ++i) {
+        damage_add_damage(damage,&swapchain->history[i%SWAPCHAIN_HISTORY]);
+    }
+}
+
+void swapchain_init(struct swapchain* swapchain, struct shm_pool* pool, int count){
+    memset(swapchain,0,sizeof(*swapchain));
+    if (count < 1){
+        count = 1;
+    }else if (count > SWAPCHAIN_MAX_BUFFERS){
+        count = SWAPCHAIN_MAX_BUFFERS;
+    }
+    swapchain->pool = pool;
+    swapchain->count = count;
+    swapchain->frame = 1;
+}
+
+void swapchain_finish(struct swapchain* swapchain){
+    for (int i = 0; i < swapchain->count; ++i) {
+        shm_pool_put_buffer(swapchain->buffers[i]);
+        swapchain->buffers[i] = NULL;
+        swapchain->buffer_frame[i] = 0;
+    }
+}
+
+void swapchain_resize(struct swapchain* swapchain, uint16_t width, uint16_t height){
+    if (swapchain->width == width && swapchain->height == height){
+        return;
+    }
+    // the buffers are kept and reshaped once they're acquired again, their content is gone though
+    for (int i = 0; i < swapchain->count; ++i) {
+        swapchain->buffer_frame[i] = 0;
+    }
+    swapchain->width = width;
+    swapchain->height = height;
+    swapchain->presented_frame = 0;
+}
+
+void swapchain_reset(struct swapchain* swapchain){
+    swapchain->presented_frame = 0;
+}
+
+void swapchain_next_frame(struct swapchain* swapchain){
+    swapchain->frame++;
+    damage_clear(&swapchain->history[swapchain->frame%SWAPCHAIN_HISTORY]);
+}
+
+void swapchain_damage(struct swapchain* swapchain, struct damage_rect rect){
+    damage_add(&swapchain->history[swapchain->frame%SWAPCHAIN_HISTORY],rect);
+}
+
+struct shm_buffer* swapchain_acquire(struct swapchain* swapchain, int* age){
+    int best = -1;
+    for (int i = 0; i < swapchain->count; ++i) {
+        struct shm_buffer* buffer = swapchain->buffers[i];
+        if (buffer == NULL){
+            // only create a new buffer if none of the existing ones is free
+            if (best < 0){
+                best = i;
+            }
+            continue;
+        }
+        if (buffer->busy){
+            continue;
+        }
+        // the buffer that was shown most recently needs the smallest repaint
+        if (best < 0 || swapchain->buffers[best] == NULL || swapchain->buffer_frame[i] > swapchain->buffer_frame[best]){
+            best = i;
+        }
+    }
+    if (best < 0){
+        swapchain->starved++;
+        return NULL;
+    }
+    struct shm_buffer* buffer = swapchain->buffers[best];
+    if (buffer != NULL && !shm_buffer_reshape(buffer,swapchain->width,swapchain->height)){
+        // too small for the new size, the pool can reuse the memory for something else
+        shm_pool_put_buffer(buffer);
+        swapchain->buffers[best] = NULL;
+        swapchain->resized++;
+    }
+    if (swapchain->buffers[best] == NULL){
+        swapchain->buffers[best] = shm_pool_get_buffer(swapchain->pool,swapchain->width,swapchain->height);
+        swapchain->buffer_frame[best] = 0;
+        if (swapchain->buffers[best] == NULL){
+            swapchain->starved++;
+            return NULL;
+        }
+    }
+    swapchain->acquired++;
+    uint64_t frame = swapchain->buffer_frame[best];
+    *age = frame == 0 ? 0 : (int)(swapchain->frame-frame);
+    return swapchain->buffers[best];
+}
+
+void swapchain_repair_region(struct swapchain* swapchain, int age, struct damage* repair){
+    if (age <= 0){
+        full_damage(swapchain,repair);
+        return;
+    }
+    damage_since(swapchain,swapchain->frame-age,repair);
+}
+
+static void mark_presented(struct swapchain* swapchain, struct shm_buffer* buffer){
+    for (int i = 0; i < swapchain->count; ++i) {
+        if (swapchain->buffers[i] == buffer){
+            swapchain->buffer_frame[i] = swapchain->frame;
+        }
+    }
+    swapchain->presented_frame = swapchain->frame;
+}
+
+bool swapchain_begin(struct swapchain* swapchain, struct swapchain_view* view){
+    int age;
+    struct shm_buffer* buffer = swapchain_acquire(swapchain,&age);
+    if (buffer == NULL){
+        return false;
+    }
+    view->buffer = buffer;
+    view->data = shm_buffer_data(buffer);
+    view->stride = buffer->stride/4;
+    view->width = buffer->width;
+    view->height = buffer->height;
+    view->age = age;
+    swapchain_repair_region(swapchain,age,&view->repair);
+    damage_clear(&view->damage);
+    return true;
+}
+
+void swapchain_view_damage(struct swapchain* swapchain, struct swapchain_view* view, struct damage_rect rect){
+    rect = damage_rect_intersect(rect,(struct damage_rect){0, 0, view->width, view->height});
+    if (damage_rect_is_empty(rect)){
+        return;
+    }
+    swapchain_damage(swapchain,rect);
+    damage_add(&view->damage,rect);
+}
+
+void swapchain_end(struct swapchain* swapchain, struct wl_surface* surface, struct swapchain_view* view){
+    // the exact list is only enough if the surface shows the previous frame, otherwise fall back to the union
+    bool exact = swapchain->presented_frame != 0 && swapchain->presented_frame+1 == swapchain->frame;
+    struct damage damage;
+    if (exact){
+        damage = view->damage;
+    }else{
+        damage_since(swapchain,swapchain->presented_frame,&damage);
+    }
+    mark_presented(swapchain,view->buffer);
+
+    shm_buffer_attach(surface,view->buffer);
+    for (int i = 0; i < damage.count; ++i) {
+        wl_surface_damage_buffer(surface,damage.rects[i].x,damage.rects[i].y,damage.rects[i].width,damage.rects[i].height);
+    }
+    swapchain->damaged_pixels += damage_area(&damage);
+}
@@ -0,0 +1,73 @@
+#ifndef REGROW_SWAPCHAIN_H
+#define REGROW_SWAPCHAIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+#include "damage.h"
+#include "shm.h"
+
+#define SWAPCHAIN_MAX_BUFFERS 3
+// number of frames of damage that are remembered, older buffers get fully repainted
+#define SWAPCHAIN_HISTORY 8
+// writable pixels of an acquired buffer together with what the renderer changed in it
+struct swapchain_view{
+    struct shm_buffer* buffer;
+    uint32_t* data;
+    // row length in pixels
+    int stride;
+    uint16_t width;
+    uint16_t height;
+    int age;
+    // has to be repainted before the buffer shows the current frame
+    struct damage repair;
+    struct damage damage;
+};
+
+// a set of buffers that are only reused after the compositor has released them
+struct swapchain{
+    struct shm_pool* pool;
+    struct shm_buffer* buffers[SWAPCHAIN_MAX_BUFFERS];
+    // frame whose content the buffer holds, 0 if the content is undefined
+    uint64_t buffer_frame[SWAPCHAIN_MAX_BUFFERS];
+    int count;
+    uint16_t width;
+    uint16_t height;
+
+    // the current frame and the damage that led to each of the last frames
+    uint64_t frame;
+    uint64_t presented_frame;
+    struct damage history[SWAPCHAIN_HISTORY];
+
+    // statistics
+    uint64_t acquired;
+    uint64_t starved;
+    // buffers that were too small after a resize
+    uint64_t resized;
+    // sum of the area of every damage rectangle sent to the compositor
+    uint64_t damaged_pixels;
+};
+
+void swapchain_init(struct swapchain* swapchain, struct shm_pool* pool, int count);
+void swapchain_finish(struct swapchain* swapchain);
+// buffers are reshaped to the new size when they're acquired, the ones that are too small get replaced
+void swapchain_resize(struct swapchain* swapchain, uint16_t width, uint16_t height);
+// the surface was given a buffer that's not ours, the next present damages everything
+void swapchain_reset(struct swapchain* swapchain);
+
+// starts a new frame, damage is collected into it until the next call
+void swapchain_next_frame(struct swapchain* swapchain);
+void swapchain_damage(struct swapchain* swapchain, struct damage_rect rect);
+
+// returns a released buffer and its age (0 = undefined content) or NULL if all buffers are still in use
+struct shm_buffer* swapchain_acquire(struct swapchain* swapchain, int* age);
+// region that has to be repainted in a buffer of the given age to show the current frame
+void swapchain_repair_region(struct swapchain* swapchain, int age, struct damage* repair);
+// acquires a buffer and maps it for the renderer, returns false if the swapchain is starved
+bool swapchain_begin(struct swapchain* swapchain, struct swapchain_view* view);
+// the renderer changed the given rectangle in this frame
+void swapchain_view_damage(struct swapchain* swapchain, struct swapchain_view* view, struct damage_rect rect);
+// presents the view, its damage rectangles are sent to the compositor as they are
+void swapchain_end(struct swapchain* swapchain, struct wl_surface* surface, struct swapchain_view* view);
+
+#endif
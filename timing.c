@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#include "timing.h"
+
+static struct histogram stages[TIMING_STAGE_COUNT];
+
+static const char* stage_names[TIMING_STAGE_COUNT] = {
+        [TIMING_FRAME_CALLBACK] = "frame callback",
+        [TIMING_GENERATE] = "generate",
+        [TIMING_RASTERIZE] = "rasterize",
+        [TIMING_SHM] = "shm buffers",
+        [TIMING_COMMIT] = "attach/commit",
+        [TIMING_DISPATCH_WAIT] = "dispatch wait"
+};
+
+// small values get a bucket each, above that the highest bits pick the power of two and the next ones the bucket in it
+static int bucket_index(uint64_t value){
+    if (value < HISTOGRAM_SUB_BUCKETS){
+        return (int)value;
+    }
+    const int msb = 63-__builtin_clzll(value);
+    const int group = msb-HISTOGRAM_SUB_BITS+1;
+    return group*HISTOGRAM_SUB_BUCKETS+(int)(value>>(group-1))-HISTOGRAM_SUB_BUCKETS;
+}
+
+static uint64_t bucket_highest(int index){
+    if (index < HISTOGRAM_SUB_BUCKETS){
+        return index;
+    }
+    const int group = index/HISTOGRAM_SUB_BUCKETS;
+    const uint64_t mantissa = index%HISTOGRAM_SUB_BUCKETS+HISTOGRAM_SUB_BUCKETS;
+    return ((mantissa+1)<<(group-1))-1;
+}
+
+void histogram_record(struct histogram* histogram, uint64_t value){
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_index(value)],1,memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count,1,memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&histogram->max,memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max,&max,value,memory_order_relaxed,memory_order_relaxed)){
+    }
+}
+
+uint64_t histogram_percentile(const struct histogram* histogram, double percentile){
+    const uint64_t count = atomic_load_explicit(&histogram->count,memory_order_relaxed);
+    if (count == 0){
+        return 0;
+    }
+    // rank of the value, counted from 1
+    uint64_t rank = (uint64_t)(percentile/100*count+0.5);
+    rank = rank < 1 ? 1 : rank > count ? count : rank;
+    const uint64_t max = atomic_load_explicit(&histogram->max,memory_order_relaxed);
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        seen += atomic_load_explicit(&histogram->buckets[i],memory_order_relaxed);
+        if (seen >= rank){
+            const uint64_t highest = bucket_highest(i);
+            return highest < max ? highest : max;
+        }
+    }
+    return max;
+}
+
+uint64_t timing_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+void timing_record(enum timing_stage stage, uint64_t start){
+    const uint64_t now = timing_now();
+    histogram_record(&stages[stage],now > start ? now-start : 0);
+}
+
+void timing_report(FILE* file){
+    fprintf(file,"%-16s %10s %10s %10s %10s %10s\n","stage (ms)","count","p50","p90","p99","max");
+    for (int i = 0; i < TIMING_STAGE_COUNT; ++i) {
+        const struct histogram* histogram = &stages[i];
+        const uint64_t count = atomic_load_explicit(&histogram->count,memory_order_relaxed);
+        if (count == 0){
+            continue;
+        }
+        fprintf(file,"%-16s %10llu %10.3f %10.3f %10.3f %10.3f\n",stage_names[i],(unsigned long long)count,
+                histogram_percentile(histogram,50)/1e6,histogram_percentile(histogram,90)/1e6,
+                histogram_percentile(histogram,99)/1e6,atomic_load_explicit(&histogram->max,memory_order_relaxed)/1e6);
+    }
+    fflush(file);
+}
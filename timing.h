@@ -0,0 +1,45 @@
+#ifndef REGROW_TIMING_H
+#define REGROW_TIMING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// every power of two is split into 2^HISTOGRAM_SUB_BITS buckets, so a value is off by at most 1/32
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1<<HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((64-HISTOGRAM_SUB_BITS+1)*HISTOGRAM_SUB_BUCKETS)
+
+// log-linear histogram of durations in ns, any thread can record into it without a lock
+struct histogram{
+    _Atomic uint64_t buckets[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t max;
+};
+
+enum timing_stage{
+    // the whole frame callback, from the reveal to the commit
+    TIMING_FRAME_CALLBACK,
+    TIMING_GENERATE,
+    TIMING_RASTERIZE,
+    // getting a buffer from the pool, growing and mapping it
+    TIMING_SHM,
+    // attach, damage and commit
+    TIMING_COMMIT,
+    // blocked in epoll_wait while a frame callback is pending, the waits of an idle window aren't recorded
+    TIMING_DISPATCH_WAIT,
+    TIMING_STAGE_COUNT
+};
+
+void histogram_record(struct histogram* histogram, uint64_t value);
+// the highest value of the bucket that contains the given percentile, 0 if it's empty
+uint64_t histogram_percentile(const struct histogram* histogram, double percentile);
+
+// CLOCK_MONOTONIC in ns
+uint64_t timing_now(void);
+// adds the time since start (from timing_now) to the stage
+void timing_record(enum timing_stage stage, uint64_t start);
+// p50/p90/p99/max of every stage that was recorded
+void timing_report(FILE* file);
+
+#endif
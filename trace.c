@@ -0,0 +1,160 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include "trace.h"
+#include "timing.h"
+
+static _Atomic bool enabled = false;
+static struct trace_ring rings[TRACE_MAX_THREADS];
+static _Atomic int ring_count = 0;
+static _Thread_local struct trace_ring* thread_ring = NULL;
+static _Thread_local bool thread_full = false;
+
+// the writer thread owns the file
+static FILE* trace_file = NULL;
+static pthread_t writer;
+static _Atomic bool writing = false;
+static bool first_event = true;
+static uint64_t trace_epoch = 0;
+
+// every thread gets its own ring the first time it records something
+static struct trace_ring* get_ring(void){
+    if (thread_ring == NULL && !thread_full){
+        const int index = atomic_fetch_add(&ring_count,1);
+        if (index < TRACE_MAX_THREADS){
+            thread_ring = &rings[index];
+        }else{
+            thread_full = true;
+        }
+    }
+    return thread_ring;
+}
+
+static void push_event(struct trace_event event){
+    struct trace_ring* ring = get_ring();
+    if (ring == NULL){
+        return;
+    }
+    const uint32_t tail = atomic_load_explicit(&ring->tail,memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&ring->head,memory_order_acquire);
+    if (tail-head == TRACE_RING_SIZE){
+        // never waits for the writer, that would show up in the timings it measures
+        atomic_fetch_add_explicit(&ring->dropped,1,memory_order_relaxed);
+        return;
+    }
+    ring->events[tail%TRACE_RING_SIZE] = event;
+    atomic_store_explicit(&ring->tail,tail+1,memory_order_release);
+}
+
+static void write_event(int tid, const struct trace_event* event){
+    fprintf(trace_file,"%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",first_event ? "" : ",",
+            event->name,event->phase,(event->time-trace_epoch)/1e3,tid);
+    if (event->phase == 'X'){
+        fprintf(trace_file,",\"dur\":%.3f}",event->duration/1e3);
+    }else{
+        fprintf(trace_file,",\"s\":\"t\"}");
+    }
+    first_event = false;
+}
+
+// moves everything the threads recorded so far into the file
+static void drain_rings(void){
+    int count = atomic_load(&ring_count);
+    count = count < TRACE_MAX_THREADS ? count : TRACE_MAX_THREADS;
+    for (int i = 0; i < count; ++i) {
+        struct trace_ring* ring = &rings[i];
+        const uint32_t head = atomic_load_explicit(&ring->head,memory_order_relaxed);
+        const uint32_t tail = atomic_load_explicit(&ring->tail,memory_order_acquire);
+        for (uint32_t j = head; j != tail; ++j) {
+            write_event(i+1,&ring->events[j%TRACE_RING_SIZE]);
+        }
+        atomic_store_explicit(&ring->head,tail,memory_order_release);
+    }
+}
+
+static void* trace_writer_run(void* data){
+    const struct timespec interval = {0, 50000000};
+    while (atomic_load(&writing)){
+        drain_rings();
+        nanosleep(&interval,NULL);
+    }
+    return NULL;
+}
+
+bool trace_start(const char* path){
+    trace_file = fopen(path,"w");
+    if (trace_file == NULL){
+        fprintf(stderr,"Error opening the trace file %s.\n",path);
+        return false;
+    }
+    fprintf(trace_file,"{\"traceEvents\":[");
+    trace_epoch = timing_now();
+    atomic_store(&writing,true);
+    if (pthread_create(&writer,NULL,trace_writer_run,NULL) != 0){
+        fprintf(stderr,"Error starting the trace writer.\n");
+        atomic_store(&writing,false);
+        fclose(trace_file);
+        trace_file = NULL;
+        return false;
+    }
+    atomic_store(&enabled,true);
+    return true;
+}
+
+void trace_stop(void){
+    if (trace_file == NULL){
+        return;
+    }
+    atomic_store(&enabled,false);
+    atomic_store(&writing,false);
+    pthread_join(writer,NULL);
+    drain_rings();
+    int count = atomic_load(&ring_count);
+    count = count < TRACE_MAX_THREADS ? count : TRACE_MAX_THREADS;
+    uint64_t dropped = 0;
+    for (int i = 0; i < count; ++i) {
+        const char* name = atomic_load(&rings[i].name);
+        if (name != NULL){
+            fprintf(trace_file,"%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first_event ? "" : ",",i+1,name);
+            first_event = false;
+        }
+        dropped += atomic_load(&rings[i].dropped);
+    }
+    fprintf(trace_file,"\n]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+    if (dropped > 0){
+        fprintf(stderr,"Error: %llu trace events were dropped, the writer couldn't keep up.\n",(unsigned long long)dropped);
+    }
+}
+
+void trace_thread_name(const char* name){
+    if (!atomic_load_explicit(&enabled,memory_order_relaxed)){
+        return;
+    }
+    struct trace_ring* ring = get_ring();
+    if (ring != NULL){
+        atomic_store(&ring->name,name);
+    }
+}
+
+uint64_t trace_begin(void){
+    return atomic_load_explicit(&enabled,memory_order_relaxed) ? timing_now() : 0;
+}
+
+void trace_end(const char* name, uint64_t start){
+    if (start == 0 || !atomic_load_explicit(&enabled,memory_order_relaxed)){
+        return;
+    }
+    const uint64_t now = timing_now();
+    push_event((struct trace_event){name, start, now > start ? now-start : 0, 'X'});
+}
+
+void trace_instant(const char* name){
+    if (!atomic_load_explicit(&enabled,memory_order_relaxed)){
+        return;
+    }
+    push_event((struct trace_event){name, timing_now(), 0, 'i'});
+}
@@ -0,0 +1,41 @@
+#ifndef REGROW_TRACE_H
+#define REGROW_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// events a thread can have in flight before the writer catches up, the ones after that are dropped
+#define TRACE_RING_SIZE 8192
+#define TRACE_MAX_THREADS 8
+
+// a span (phase X with its duration) or an instant event (phase i), the name has to be a string literal
+struct trace_event{
+    const char* name;
+    uint64_t time;
+    uint64_t duration;
+    char phase;
+};
+
+// written only by its thread, read only by the writer
+struct trace_ring{
+    struct trace_event events[TRACE_RING_SIZE];
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic(const char*) name;
+    _Atomic uint64_t dropped;
+};
+
+// starts writing a Chrome trace (JSON, opens in Perfetto) to the file, returns false if it can't be created
+bool trace_start(const char* path);
+// writes the remaining events and closes the file, the other threads must not record anything anymore
+void trace_stop(void);
+// name of the calling thread in the trace
+void trace_thread_name(const char* name);
+// start of a span, 0 while tracing is off
+uint64_t trace_begin(void);
+// ends the span that started at start (from trace_begin)
+void trace_end(const char* name, uint64_t start);
+void trace_instant(const char* name);
+
+#endif
@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200112L
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tree.h"
+
+const uint32_t tree_palette[TREE_COLOR_COUNT] = {
+        [TREE_COLOR_TRUNK] = 0xFFA52A2A,
+        [TREE_COLOR_LEAVES] = 0xFF00FF00
+};
+
+void tree_skeleton_init(struct tree_skeleton* skeleton){
+    memset(skeleton,0,sizeof(*skeleton));
+}
+
+void tree_skeleton_finish(struct tree_skeleton* skeleton){
+    free(skeleton->arena);
+    tree_skeleton_init(skeleton);
+}
+
+void tree_skeleton_clear(struct tree_skeleton* skeleton, uint16_t width, uint16_t height){
+    skeleton->count = 0;
+    skeleton->width = width;
+    skeleton->height = height;
+}
+
+// moves every array into a new arena that holds twice as many segments
+static bool tree_skeleton_grow(struct tree_skeleton* skeleton){
+    uint32_t capacity = skeleton->capacity ? skeleton->capacity*2 : 256;
+    // 4 coordinates of 2 bytes and 4 single byte fields per segment
+    uint8_t* arena = malloc((size_t)capacity*(4*sizeof(int16_t)+4));
+    if (arena == NULL){
+        return false;
+    }
+    int16_t* coordinates = (int16_t*)arena;
+    uint8_t* bytes = arena+(size_t)capacity*4*sizeof(int16_t);
+    struct tree_skeleton grown = *skeleton;
+    grown.x0 = coordinates;
+    grown.y0 = coordinates+capacity;
+    grown.x1 = coordinates+capacity*2;
+    grown.y1 = coordinates+capacity*3;
+    grown.thickness = bytes;
+    grown.depth = bytes+capacity;
+    grown.color = bytes+capacity*2;
+    grown.shape = bytes+capacity*3;
+    if (skeleton->count > 0){
+        memcpy(grown.x0,skeleton->x0,skeleton->count*sizeof(int16_t));
+        memcpy(grown.y0,skeleton->y0,skeleton->count*sizeof(int16_t));
+        memcpy(grown.x1,skeleton->x1,skeleton->count*sizeof(int16_t));
+        memcpy(grown.y1,skeleton->y1,skeleton->count*sizeof(int16_t));
+        memcpy(grown.thickness,skeleton->thickness,skeleton->count);
+        memcpy(grown.depth,skeleton->depth,skeleton->count);
+        memcpy(grown.color,skeleton->color,skeleton->count);
+        memcpy(grown.shape,skeleton->shape,skeleton->count);
+    }
+    free(skeleton->arena);
+    grown.arena = arena;
+    grown.capacity = capacity;
+    *skeleton = grown;
+    return true;
+}
+
+static bool fits_16(int value){
+    return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+static bool tree_skeleton_push(struct tree_skeleton* skeleton, int x0, int y0, int x1, int y1, uint8_t thickness, uint8_t depth, enum tree_color color, enum tree_shape shape){
+    if (!fits_16(x0) || !fits_16(y0) || !fits_16(x1) || !fits_16(y1)){
+        // the generators stay in range for buffers up to TREE_MAX_SIZE, a segment out of it is left out
+        // instead of wrapping around to the other side
+        return true;
+    }
+    if (skeleton->count == skeleton->capacity && !tree_skeleton_grow(skeleton)){
+        return false;
+    }
+    uint32_t i = skeleton->count++;
+    skeleton->x0[i] = x0;
+    skeleton->y0[i] = y0;
+    skeleton->x1[i] = x1;
+    skeleton->y1[i] = y1;
+    skeleton->thickness[i] = thickness;
+    skeleton->depth[i] = depth;
+    skeleton->color[i] = color;
+    skeleton->shape[i] = shape;
+    return true;
+}
+
+bool tree_skeleton_add(struct tree_skeleton* skeleton, int x0, int y0, int x1, int y1, uint8_t thickness, uint8_t depth, enum tree_color color){
+    return tree_skeleton_push(skeleton,x0,y0,x1,y1,thickness,depth,color,TREE_SHAPE_LINE);
+}
+
+bool tree_skeleton_add_arc(struct tree_skeleton* skeleton, int x, int y, int end_x, uint8_t depth){
+    return tree_skeleton_push(skeleton,x,y,end_x,y,1,depth,TREE_COLOR_LEAVES,TREE_SHAPE_ARC);
+}
+
+// shape of the foliage arc, (int)(50*sin(i degrees)) rows above the top of the trunk for the i-th pixel
+// from it. It only depends on i, so one table serves every level of every tree and is only extended
+// when a wider branch shows up.
+struct arc_table{
+    int8_t* heights;
+    uint16_t length;
+};
+
+static _Thread_local struct arc_table arc_table;
+
+const int8_t* tree_arc_heights(uint16_t length){
+    struct arc_table* table = &arc_table;
+    if (table->length < length){
+        int8_t* heights = realloc(table->heights,length);
+        if (heights == NULL){
+            return NULL;
+        }
+        table->heights = heights;
+        for (int i = table->length; i < length; ++i) {
+            table->heights[i] = (int8_t)(int)(ARC_HEIGHT * sin(i * 3.1414 / 180));
+        }
+        table->length = length;
+    }
+    return table->heights;
+}
+
+static uint8_t depth_of(int level){
+    return level > UINT8_MAX ? UINT8_MAX : level;
+}
+
+// one half of the foliage arc, direction is -1 for the left and 1 for the right half. It's a single
+// segment that the rasterizer draws from the arc table, one store per column.
+static bool generate_arc(struct tree_skeleton* skeleton, int x, int y, int length, int direction, uint8_t depth){
+    if (length <= 0){
+        return true;
+    }
+    return tree_skeleton_add_arc(skeleton,x,y,x+direction*(length-1),depth);
+}
+
+bool generate_tree_new(struct tree_skeleton* skeleton, int x, int y, uint16_t tree_size, uint16_t branch_width){
+    const int width = skeleton->width;
+    int level = 0;
+    while (tree_size>20 && branch_width>20 && (y-tree_size-ARC_HEIGHT)*width+x>0) {
+        if (!tree_skeleton_add(skeleton,x,y,x,y-tree_size+1,1,depth_of(level),TREE_COLOR_TRUNK)){
+            return false;
+        }
+        y -= tree_size;
+        if (!generate_arc(skeleton,x,y,branch_width,-1,depth_of(level))
+            || !generate_arc(skeleton,x,y,branch_width,1,depth_of(level))){
+            return false;
+        }
+        tree_size-=tree_size/5;
+        branch_width/=2;
+        level++;
+    }
+    return true;
+}
+
+// limits how many distinct branches a single tree may have, 0 means no limit
+static uint32_t branch_budget = BRANCH_BUDGET_DEFAULT;
+
+// scratch memory of the branch generator, kept between trees so that steady state doesn't allocate
+struct branch_scratch{
+    int* stack;
+    size_t stack_capacity;
+    uint8_t* visited;
+    size_t visited_capacity;
+};
+
+static _Thread_local struct branch_scratch branch_scratch;
+
+static bool reserve(void** data, size_t* capacity, size_t count, size_t size){
+    if (*capacity >= count){
+        return true;
+    }
+    void* grown = realloc(*data,count*size);
+    if (grown == NULL){
+        return false;
+    }
+    *data = grown;
+    *capacity = count;
+    return true;
+}
+
+void tree_thread_finish(void){
+    free(branch_scratch.stack);
+    free(branch_scratch.visited);
+    memset(&branch_scratch,0,sizeof(branch_scratch));
+    free(arc_table.heights);
+    memset(&arc_table,0,sizeof(arc_table));
+}
+
+void set_branch_budget(uint32_t budget){
+    branch_budget = budget;
+}
+
+// every branch ends in two new ones, one up left and one up right. Going left then right lands on the
+// same spot as going right then left, so the branches form a grid of branch_size cells and each of them
+// only has to be generated once. That keeps the work linear in the number of pixels instead of 2^depth.
+bool generate_branches(struct tree_skeleton* skeleton, int start_x, int start_y, uint16_t branch_size){
+    const int w = skeleton->width;
+    const int size = branch_size;
+    if (size == 0 || w == 0 || start_y*w+start_x <= w*size){
+        return true;
+    }
+    // branches whose lines are completely left or right of the buffer aren't generated nor followed
+    const int left = start_x >= 0 ? (start_x+size-1)/size : 0;
+    const int right = w-1+size-1-start_x >= 0 ? (w-1+size-1-start_x)/size : 0;
+    const int columns = left+right+1;
+    const int levels = start_y/size+1;
+
+    struct branch_scratch* scratch = &branch_scratch;
+    const size_t slots = (size_t)columns*levels;
+    if (!reserve((void**)&scratch->visited,&scratch->visited_capacity,(slots+7)/8,1)
+        || !reserve((void**)&scratch->stack,&scratch->stack_capacity,slots,sizeof(int))){
+        return false;
+    }
+    memset(scratch->visited,0,(slots+7)/8);
+
+    size_t count = 0;
+    uint32_t generated = 0;
+    const int root = left;
+    scratch->stack[count++] = root;
+    scratch->visited[root/8] |= 1<<(root%8);
+    while (count > 0){
+        if (branch_budget != 0 && generated == branch_budget){
+            break;
+        }
+        const int slot = scratch->stack[--count];
+        const int level = slot/columns;
+        const int column = slot%columns;
+        const int x = start_x+(column-left)*size;
+        const int y = start_y-level*size;
+        if (!tree_skeleton_add(skeleton,x,y,x-size+1,y-size+1,1,depth_of(level),TREE_COLOR_LEAVES)
+            || !tree_skeleton_add(skeleton,x,y,x+size-1,y-size+1,1,depth_of(level),TREE_COLOR_LEAVES)){
+            return false;
+        }
+        generated++;
+        const int children[2] = {column-1, column+1};
+        for (int c = 0; c < 2; ++c) {
+            if (children[c] < 0 || children[c] >= columns){
+                continue;
+            }
+            const int child_x = start_x+(children[c]-left)*size;
+            if ((y-size)*w+child_x <= w*size){
+                continue;
+            }
+            const int child = (level+1)*columns+children[c];
+            if (scratch->visited[child/8] & (1<<(child%8))){
+                continue;
+            }
+            scratch->visited[child/8] |= 1<<(child%8);
+            scratch->stack[count++] = child;
+        }
+    }
+    return true;
+}
+
+bool generate_tree(struct tree_skeleton* skeleton, uint16_t branch_size){
+    const int width = skeleton->width;
+    const int height = skeleton->height;
+    branch_size=branch_size/2;
+    if (height/4 > 1 && !tree_skeleton_add(skeleton,width/2,height-1,width/2,height-height/4+1,1,0,TREE_COLOR_TRUNK)){
+        return false;
+    }
+    return generate_branches(skeleton,width/2,height-height/4,branch_size);
+}
+
+// a buffer narrower or lower than 2 pixels has no room to roll in, it gets the smallest tree
+struct tree_params tree_params_random(uint16_t width, uint16_t height){
+    struct tree_params params;
+    params.branch_width=(width/2 ? rand()%(width/2) : 0)+50;
+    params.tree_size=(height/2 ? rand()%(height/2) : 0)+100;
+    params.tree_type=rand()%2;
+    return params;
+}
+
+struct tree_params tree_params_random_r(unsigned int* seed, uint16_t width, uint16_t height){
+    struct tree_params params;
+    params.branch_width=(width/2 ? rand_r(seed)%(width/2) : 0)+50;
+    params.tree_size=(height/2 ? rand_r(seed)%(height/2) : 0)+100;
+    params.tree_type=rand_r(seed)%2;
+    return params;
+}
+
+bool generate_skeleton(struct tree_skeleton* skeleton, uint16_t width, uint16_t height, const struct tree_params* params){
+    if (width > TREE_MAX_SIZE || height > TREE_MAX_SIZE){
+        return false;
+    }
+    tree_skeleton_clear(skeleton,width,height);
+    if (params->tree_type==0) {
+        return generate_tree(skeleton,params->branch_width);
+    }
+    return generate_tree_new(skeleton,width/2,height-1,params->tree_size,params->branch_width);
+}
@@ -0,0 +1,85 @@
+#ifndef REGROW_TREE_H
+#define REGROW_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// random parameters that describe a single tree
+struct tree_params{
+    uint16_t tree_size;
+    uint16_t branch_width;
+    uint16_t tree_type;
+};
+
+// distinct branches a tree made by generate_branches may have before the rest is cut off
+#define BRANCH_BUDGET_DEFAULT (1<<20)
+
+enum tree_color{
+    TREE_COLOR_TRUNK,
+    TREE_COLOR_LEAVES,
+    TREE_COLOR_COUNT
+};
+
+extern const uint32_t tree_palette[TREE_COLOR_COUNT];
+
+enum tree_shape{
+    // straight line from (x0, y0) to (x1, y1)
+    TREE_SHAPE_LINE,
+    // half of a foliage arc, one pixel per column from x0 to x1 at y0 minus the row of tree_arc_heights
+    TREE_SHAPE_ARC
+};
+
+// highest point of the foliage arc above (and lowest below) the top of the trunk
+#define ARC_HEIGHT 50
+
+// the segments a tree is made of, generated once and rasterized as often as needed.
+// Every field is its own array (struct of arrays) and all of them live in a single arena.
+struct tree_skeleton{
+    int16_t* x0;
+    int16_t* y0;
+    int16_t* x1;
+    int16_t* y1;
+    uint8_t* thickness;
+    uint8_t* depth;
+    uint8_t* color;
+    uint8_t* shape;
+    uint32_t count;
+    uint32_t capacity;
+    void* arena;
+    // size of the buffer the tree was generated for, coordinates are scaled when rasterizing at another size
+    uint16_t width;
+    uint16_t height;
+};
+
+void tree_skeleton_init(struct tree_skeleton* skeleton);
+void tree_skeleton_finish(struct tree_skeleton* skeleton);
+// drops the segments but keeps the arena
+void tree_skeleton_clear(struct tree_skeleton* skeleton, uint16_t width, uint16_t height);
+bool tree_skeleton_add(struct tree_skeleton* skeleton, int x0, int y0, int x1, int y1, uint8_t thickness, uint8_t depth, enum tree_color color);
+bool tree_skeleton_add_arc(struct tree_skeleton* skeleton, int x, int y, int end_x, uint8_t depth);
+// rows above the top of the trunk of the first length pixels of a foliage arc, cached per thread,
+// NULL if it ran out of memory
+const int8_t* tree_arc_heights(uint16_t length);
+
+// largest buffer a tree is generated for. Skeleton coordinates are int16 and a tree reaches about half
+// the buffer width past its trunk in the middle, so every coordinate of a tree up to this size fits.
+#define TREE_MAX_SIZE 16384
+
+// rolls the parameters of a new tree for a window of the given size
+struct tree_params tree_params_random(uint16_t width, uint16_t height);
+// same as above with its own random state, for threads other than the main one
+struct tree_params tree_params_random_r(unsigned int* seed, uint16_t width, uint16_t height);
+// 0 removes the limit
+void set_branch_budget(uint32_t budget);
+// frees the scratch memory the generators keep for the calling thread
+void tree_thread_finish(void);
+
+// the generators add the segments of a tree to the skeleton, they return false if it ran out of memory
+bool generate_tree_new(struct tree_skeleton* skeleton, int x, int y, uint16_t tree_size, uint16_t branch_width);
+bool generate_branches(struct tree_skeleton* skeleton, int x, int y, uint16_t branch_size);
+bool generate_tree(struct tree_skeleton* skeleton, uint16_t branch_size);
+// clears the skeleton and generates the whole tree described by params, false for a buffer above TREE_MAX_SIZE
+bool generate_skeleton(struct tree_skeleton* skeleton, uint16_t width, uint16_t height, const struct tree_params* params);
+
+#endif
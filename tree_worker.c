@@ -0,0 +1,214 @@
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "tree_worker.h"
+#include "timing.h"
+#include "trace.h"
+
+static bool tree_queue_push(struct tree_queue* queue, struct tree_frame* frame){
+    const uint32_t tail = atomic_load_explicit(&queue->tail,memory_order_relaxed);
+    const uint32_t head = atomic_load_explicit(&queue->head,memory_order_acquire);
+    if (tail-head == TREE_QUEUE_SIZE){
+        return false;
+    }
+    queue->frames[tail%TREE_QUEUE_SIZE] = frame;
+    // publishes the frame together with everything that was written into it
+    atomic_store_explicit(&queue->tail,tail+1,memory_order_release);
+    return true;
+}
+
+static struct tree_frame* tree_queue_pop(struct tree_queue* queue){
+    const uint32_t head = atomic_load_explicit(&queue->head,memory_order_relaxed);
+    const uint32_t tail = atomic_load_explicit(&queue->tail,memory_order_acquire);
+    if (head == tail){
+        return NULL;
+    }
+    struct tree_frame* frame = queue->frames[head%TREE_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head,head+1,memory_order_release);
+    return frame;
+}
+
+static bool rasterize_frame(struct tree_frame* frame, uint16_t width, uint16_t height){
+    const uint64_t start = timing_now();
+    frame->bounds = skeleton_bounds(&frame->skeleton,width,height);
+    const bool rendered = render_skeleton(frame->target,width,height,&frame->skeleton);
+    timing_record(TIMING_RASTERIZE,start);
+    trace_end("rasterize",start);
+    if (!rendered){
+        fprintf(stderr,"Error allocating the tree buffer.\n");
+        return false;
+    }
+    return true;
+}
+
+bool tree_frame_render(struct tree_frame* frame, uint16_t width, uint16_t height){
+    if (!render_target_prepare(frame->target,width,height)){
+        fprintf(stderr,"Error allocating the tree buffer.\n");
+        return false;
+    }
+    return rasterize_frame(frame,width,height);
+}
+
+static void draw_tree_frame(struct tree_worker* worker, struct tree_frame* frame){
+    const uint64_t span = trace_begin();
+    const uint32_t size = atomic_load(&worker->size);
+    uint16_t width = size>>16;
+    uint16_t height = size&0xFFFF;
+    if (frame->target->interface->prepare != NULL){
+        // it can't be resized here, the render thread prepared it for the size it had when it gave the
+        // frame back. After a resize since then it's rasterized again when it's taken.
+        width = frame->target->width;
+        height = frame->target->height;
+    }
+    frame->params = tree_params_random_r(&worker->seed,width,height);
+    const uint64_t start = timing_now();
+    const bool generated = generate_skeleton(&frame->skeleton,width,height,&frame->params);
+    timing_record(TIMING_GENERATE,start);
+    trace_end("generate_skeleton",start);
+    if (!generated){
+        fprintf(stderr,"Error allocating the tree skeleton.\n");
+    }
+    rasterize_frame(frame,width,height);
+    trace_end("tree job",span);
+}
+
+static void* tree_worker_run(void* data){
+    struct tree_worker* worker = data;
+    trace_thread_name("tree worker");
+    while (true){
+        while (sem_wait(&worker->wake) != 0 && errno == EINTR){
+        }
+        if (!atomic_load(&worker->running)){
+            break;
+        }
+        struct tree_frame* frame = tree_queue_pop(&worker->free);
+        if (frame == NULL){
+            continue;
+        }
+        draw_tree_frame(worker,frame);
+        tree_queue_push(&worker->ready,frame);
+        const uint64_t one = 1;
+        if (write(worker->ready_fd,&one,sizeof(one)) < 0 && errno != EAGAIN){
+            fprintf(stderr,"Error signaling a finished tree.\n");
+        }
+    }
+    tree_thread_finish();
+    return NULL;
+}
+
+// hands a frame to the worker so it draws the next tree into it
+static void give_back(struct tree_worker* worker, struct tree_frame* frame){
+    const uint32_t size = atomic_load(&worker->size);
+    if (!render_target_prepare(frame->target,size>>16,size&0xFFFF)){
+        fprintf(stderr,"Error allocating the tree buffer.\n");
+    }
+    tree_queue_push(&worker->free,frame);
+    sem_post(&worker->wake);
+}
+
+bool tree_worker_start(struct tree_worker* worker, uint16_t width, uint16_t height, unsigned int seed, struct shm_pool* pool){
+    memset(worker,0,sizeof(*worker));
+    worker->ready_fd = -1;
+    worker->seed = seed;
+    atomic_store(&worker->size,(uint32_t)width<<16|height);
+    atomic_store(&worker->running,true);
+    if (sem_init(&worker->wake,0,0) != 0){
+        fprintf(stderr,"Error creating the tree worker semaphore.\n");
+        return false;
+    }
+    worker->ready_fd = eventfd(0,EFD_CLOEXEC|EFD_NONBLOCK);
+    if (worker->ready_fd < 0){
+        fprintf(stderr,"Error creating the tree worker eventfd.\n");
+        sem_destroy(&worker->wake);
+        return false;
+    }
+    for (int i = 0; i < TREE_WORKER_FRAMES; ++i) {
+        tree_skeleton_init(&worker->frames[i].skeleton);
+        if (pool != NULL){
+            struct shm_target* target = shm_target_create(pool);
+            worker->frames[i].target = target != NULL ? &target->base : NULL;
+        }else{
+            struct memory_target* target = memory_target_create(NULL,IMAGE_FORMAT_PPM);
+            worker->frames[i].target = target != NULL ? &target->base : NULL;
+        }
+        if (worker->frames[i].target == NULL){
+            fprintf(stderr,"Error creating the tree worker targets.\n");
+            tree_worker_stop(worker);
+            return false;
+        }
+    }
+    if (pthread_create(&worker->thread,NULL,tree_worker_run,worker) != 0){
+        fprintf(stderr,"Error starting the tree worker.\n");
+        tree_worker_stop(worker);
+        return false;
+    }
+    worker->started = true;
+    for (int i = 0; i < TREE_WORKER_FRAMES; ++i) {
+        give_back(worker,&worker->frames[i]);
+    }
+    return true;
+}
+
+void tree_worker_stop(struct tree_worker* worker){
+    if (worker->started){
+        atomic_store(&worker->running,false);
+        sem_post(&worker->wake);
+        pthread_join(worker->thread,NULL);
+        worker->started = false;
+    }
+    for (int i = 0; i < TREE_WORKER_FRAMES; ++i) {
+        if (worker->frames[i].target != NULL){
+            render_target_destroy(worker->frames[i].target);
+            worker->frames[i].target = NULL;
+        }
+        tree_skeleton_finish(&worker->frames[i].skeleton);
+    }
+    sem_destroy(&worker->wake);
+    if (worker->ready_fd >= 0){
+        close(worker->ready_fd);
+        worker->ready_fd = -1;
+    }
+    worker->current = NULL;
+}
+
+void tree_worker_resize(struct tree_worker* worker, uint16_t width, uint16_t height){
+    atomic_store(&worker->size,(uint32_t)width<<16|height);
+}
+
+void tree_worker_clear_ready(struct tree_worker* worker){
+    uint64_t count;
+    if (read(worker->ready_fd,&count,sizeof(count)) < 0 && errno != EAGAIN){
+        fprintf(stderr,"Error reading the tree worker eventfd.\n");
+    }
+}
+
+bool tree_worker_next(struct tree_worker* worker, bool wait){
+    struct tree_frame* frame = tree_queue_pop(&worker->ready);
+    while (frame == NULL && wait){
+        // the count is cleared before the pop, a tree pushed after that signals the eventfd again
+        struct pollfd pollfd = {worker->ready_fd, POLLIN, 0};
+        poll(&pollfd,1,-1);
+        tree_worker_clear_ready(worker);
+        frame = tree_queue_pop(&worker->ready);
+    }
+    if (frame == NULL){
+        return false;
+    }
+    // the window was resized while the tree was drawn, the skeleton gets stretched to the new size
+    const uint32_t size = atomic_load(&worker->size);
+    const uint16_t width = size>>16;
+    const uint16_t height = size&0xFFFF;
+    if (frame->target->width != width || frame->target->height != height){
+        tree_frame_render(frame,width,height);
+    }
+    if (worker->current != NULL){
+        give_back(worker,worker->current);
+    }
+    worker->current = frame;
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef REGROW_TREE_WORKER_H
+#define REGROW_TREE_WORKER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "render.h"
+#include "shm.h"
+#include "tree.h"
+
+// the tree on screen, the one waiting in the queue and the one the worker is drawing
+#define TREE_WORKER_FRAMES 3
+// power of two that's big enough to hold every frame
+#define TREE_QUEUE_SIZE 4
+
+// a finished tree, both its skeleton and its pixels
+struct tree_frame{
+    struct tree_params params;
+    struct tree_skeleton skeleton;
+    // a memory target, or with a pool an shm target the tree surface shows as it is
+    struct render_target* target;
+    // the part of target the tree covers, everything else is black
+    struct clip_rect bounds;
+};
+
+// lock free queue with exactly one thread pushing and one popping
+struct tree_queue{
+    struct tree_frame* frames[TREE_QUEUE_SIZE];
+    // only written by the consumer
+    _Atomic uint32_t head;
+    // only written by the producer
+    _Atomic uint32_t tail;
+};
+
+// draws the next tree on its own thread while the current one is being revealed
+struct tree_worker{
+    pthread_t thread;
+    bool started;
+    // posted whenever a frame is given back or the worker should stop
+    sem_t wake;
+    _Atomic bool running;
+    // width<<16|height of the trees that should be drawn
+    _Atomic uint32_t size;
+    unsigned int seed;
+    // render thread -> worker
+    struct tree_queue free;
+    // worker -> render thread
+    struct tree_queue ready;
+    // eventfd that's signaled after every tree pushed to ready, so an event loop can wait for it
+    int ready_fd;
+    struct tree_frame frames[TREE_WORKER_FRAMES];
+    // owned by the render thread, NULL until the first tree is taken
+    struct tree_frame* current;
+};
+
+// rasterizes the skeleton of the frame at the given size on the render thread, returns false if the
+// target couldn't be resized
+bool tree_frame_render(struct tree_frame* frame, uint16_t width, uint16_t height);
+
+// with a pool the trees are drawn into its buffers, the pool is only used on the thread that calls
+// tree_worker_next (and here)
+bool tree_worker_start(struct tree_worker* worker, uint16_t width, uint16_t height, unsigned int seed, struct shm_pool* pool);
+void tree_worker_stop(struct tree_worker* worker);
+// trees that are started from now on are drawn for the new size
+void tree_worker_resize(struct tree_worker* worker, uint16_t width, uint16_t height);
+// resets ready_fd, after that it's only signaled by trees that are pushed later
+void tree_worker_clear_ready(struct tree_worker* worker);
+// replaces the current tree with the next finished one, returns false if there's none yet.
+// With wait it blocks until there is one.
+bool tree_worker_next(struct tree_worker* worker, bool wait);
+
+#endif